@@ -11,6 +11,11 @@ LFLAGS_EXTRA="-march=rv32imafdc -mabi=ilp32d -Wl,--gc-sections $LDFLAGS"
 CM_FOLDER=coremark
 PORT_FOLDER=riscv32-spike
 
+# COREMARK_HARTS=n runs n contexts, one per hart, see core_portme.c
+HARTS=${COREMARK_HARTS:-1}
+# COREMARK_KERNELS=1 counts list, matrix, state and CRC separately, see core_kernels.c
+KERNELS=${COREMARK_KERNELS:-0}
+
 rm -f $BASEDIR/$CM_FOLDER/*.o
 rm -f $BASEDIR/$PORT_FOLDER/*.o
 
@@ -20,10 +25,16 @@ make clean
 
 # run the compile
 echo "Start compilation"
-make PORT_DIR="../"$PORT_FOLDER ITERATIONS=10 LFLAGS_EXTRA="$LFLAGS_EXTRA" USER_FLAGS="$FLAGS" TC=$TC_FOLDER link
+# CC_LAUNCHER is optional, see build_cache.py
+make CC="${CC_LAUNCHER:+$CC_LAUNCHER }$CC" PORT_DIR="../"$PORT_FOLDER ITERATIONS=10 XCFLAGS="-DMULTITHREAD=$HARTS" KERNELS=$KERNELS LFLAGS_EXTRA="$LFLAGS_EXTRA" USER_FLAGS="$FLAGS" TC=$TC_FOLDER link
 
 #make PORT_DIR=../riscv64-baremetal compile
 mv coremark.riscv ../
 cd ..
+# The harness simulates by itself, see run_all.py
+if [ "$1" = "--no-run" ]; then
+    exit 0
+fi
 echo "Start simulation (takes time)"
-script '-c' 'spike --isa=rv32gc_Zicsr coremark.riscv' '-e'
+# SIM_LAUNCHER is optional, see sim_cache.py
+${SIM_LAUNCHER:+$SIM_LAUNCHER coremark.riscv --} script '-c' "spike -p$HARTS --isa=rv32gc_Zicsr coremark.riscv" '-e'
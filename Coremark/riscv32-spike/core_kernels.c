@@ -0,0 +1,114 @@
+/* Copyright HighTec EDV-Systeme GmbH 2023
+
+   SPDX-License-Identifier: Apache-2.0 */
+
+/* Per-kernel counts for KERNELS=1 builds (see core_portme.mak). The linker
+   sends the calls of the list, matrix and state benchmarks and of the CRC
+   helpers through the __wrap_* functions below, so the EEMBC sources stay
+   untouched. The kernels nest (the list sort calls the matrix and state
+   benchmarks, all of them call the CRC helpers), so counts are charged to
+   the innermost kernel running. Everything else in iterate() is "other".
+   The wrappers themselves cost a few dozen instructions per call, which
+   mostly lands on the CRC. */
+
+#if CORE_KERNELS
+
+#include "coremark.h"
+#include "../../common/perf_counters.h"
+
+enum { KERNEL_OTHER, KERNEL_LIST, KERNEL_MATRIX, KERNEL_STATE, KERNEL_CRC, KERNELS };
+static const char *kernel_names[KERNELS] = { "other", "list", "matrix", "state", "crc" };
+static struct perf_counters kernel_last;
+static struct perf_counters kernel_sum[KERNELS];
+static int kernel_current;
+
+ee_u16 __real_core_bench_list(core_results *res, ee_s16 finder_idx);
+ee_u16 __real_core_bench_matrix(mat_params *p, ee_s16 seed, ee_u16 crc);
+ee_u16 __real_core_bench_state(ee_u32 blksize, ee_u8 *memblock, ee_s16 seed1,
+		ee_s16 seed2, ee_s16 step, ee_u16 crc);
+ee_u16 __real_crc16(ee_s16 newval, ee_u16 crc);
+ee_u16 __real_crcu16(ee_u16 newval, ee_u16 crc);
+ee_u16 __real_crcu32(ee_u32 newval, ee_u16 crc);
+
+/* Charge the counts since the last switch to the running kernel and make
+   "kernel" the running one. Returns the kernel to switch back to. With
+   several harts, only hart 0 is broken down. */
+static int kernel_switch(int kernel) {
+	struct perf_counters now;
+	int prev=kernel_current;
+#if MULTITHREAD>1
+	if (PERF_READ_CSR(mhartid)!=0)
+		return prev;
+#endif
+	perf_read(&now);
+	perf_add(&kernel_sum[prev],&kernel_last,&now);
+	kernel_last=now;
+	kernel_current=kernel;
+	return prev;
+}
+
+void kernels_start(void) {
+	int i;
+	for (i=0; i<KERNELS; i++)
+		kernel_sum[i]=(struct perf_counters){0};
+	kernel_current=KERNEL_OTHER;
+	perf_read(&kernel_last);
+}
+
+void kernels_stop(void) {
+	static const struct perf_counters zero;
+	char name[32];
+	uint64_t total=0;
+	int i;
+	kernel_switch(KERNEL_OTHER);
+	for (i=0; i<KERNELS; i++) {
+		snprintf(name,sizeof(name),"coremark.%s",kernel_names[i]);
+		perf_report(name,&zero,&kernel_sum[i]);
+		total+=kernel_sum[i].cycles;
+	}
+	for (i=0; i<KERNELS; i++) {
+		ee_printf("Kernel %-6s : %12llu cycles, %5.1f%%\n",kernel_names[i],
+				(unsigned long long)kernel_sum[i].cycles,
+				total ? 100.0*kernel_sum[i].cycles/total : 0.0);
+	}
+}
+
+ee_u16 __wrap_core_bench_list(core_results *res, ee_s16 finder_idx) {
+	int prev=kernel_switch(KERNEL_LIST);
+	ee_u16 retval=__real_core_bench_list(res,finder_idx);
+	kernel_switch(prev);
+	return retval;
+}
+ee_u16 __wrap_core_bench_matrix(mat_params *p, ee_s16 seed, ee_u16 crc) {
+	int prev=kernel_switch(KERNEL_MATRIX);
+	ee_u16 retval=__real_core_bench_matrix(p,seed,crc);
+	kernel_switch(prev);
+	return retval;
+}
+ee_u16 __wrap_core_bench_state(ee_u32 blksize, ee_u8 *memblock, ee_s16 seed1,
+		ee_s16 seed2, ee_s16 step, ee_u16 crc) {
+	int prev=kernel_switch(KERNEL_STATE);
+	ee_u16 retval=__real_core_bench_state(blksize,memblock,seed1,seed2,step,crc);
+	kernel_switch(prev);
+	return retval;
+}
+ee_u16 __wrap_crc16(ee_s16 newval, ee_u16 crc) {
+	int prev=kernel_switch(KERNEL_CRC);
+	ee_u16 retval=__real_crc16(newval,crc);
+	kernel_switch(prev);
+	return retval;
+}
+ee_u16 __wrap_crcu16(ee_u16 newval, ee_u16 crc) {
+	int prev=kernel_switch(KERNEL_CRC);
+	ee_u16 retval=__real_crcu16(newval,crc);
+	kernel_switch(prev);
+	return retval;
+}
+ee_u16 __wrap_crcu32(ee_u32 newval, ee_u16 crc) {
+	int prev=kernel_switch(KERNEL_CRC);
+	ee_u16 retval=__real_crcu32(newval,crc);
+	kernel_switch(prev);
+	return retval;
+}
+
+#endif /* CORE_KERNELS */
@@ -19,6 +19,10 @@ Original Author: Shay Gal-on
 #include <stdio.h>
 #include <stdlib.h>
 #include "coremark.h"
+#if !USE_CLOCK && !defined(_MSC_VER) && !HAS_TIME_H
+#include "../../common/perf_counters.h"
+#define PERF_COUNTERS 1
+#endif
 #if CALLGRIND_RUN
 #include <valgrind/callgrind.h>
 #endif
@@ -136,6 +140,13 @@ static CORETIMETYPE start_time_val, stop_time_val;
 	or zeroing some system parameters - e.g. setting the cpu clocks cycles to 0.
 */
 void start_time(void) {
+	/* Counter bookkeeping goes before the timestamp, it isn't part of the score */
+#if CORE_KERNELS
+	kernels_start();
+#endif
+#if PERF_COUNTERS
+	perf_start();
+#endif
 	GETMYTIME(&start_time_val);
 #if CALLGRIND_RUN
 	CALLGRIND_START_INSTRUMENTATION
@@ -158,6 +169,12 @@ void stop_time(void) {
     asm volatile("int3");/*1 */
 #endif
 	GETMYTIME(&stop_time_val);
+#if PERF_COUNTERS
+	perf_stop("coremark");
+#endif
+#if CORE_KERNELS
+	kernels_stop();
+#endif
 }
 /* Function: get_time
 	Return an abstract "ticks" number that signifies time on the system.
@@ -188,6 +205,18 @@ secs_ret time_in_secs(CORE_TICKS ticks) {
 
 ee_u32 default_num_contexts=MULTITHREAD;
 
+#if (MULTITHREAD>1) && USE_HARTS
+/* Released by portable_init, the other harts spin on it in crt0.S */
+volatile ee_u32 harts_released;
+/* Context handed to each hart by core_start_parallel */
+static core_results *hart_mailbox[MULTITHREAD];
+/* Harts that have reached the start barrier, and harts done with iterate */
+static ee_u32 harts_ready;
+static ee_u32 hart_done[MULTITHREAD];
+/* mcycle ticks each hart spent in iterate */
+static CORE_TICKS hart_ticks[MULTITHREAD];
+#endif
+
 /* Function: portable_init
 	Target specific initialization code
 	Test for some common mistakes.
@@ -223,6 +252,9 @@ void portable_init(core_portable *p, int *argc, char *argv[])
 		*argc=nargs;
 	}
 #endif /* sample of potential platform specific init via command line, reset the number of contexts being used if first argument is M<n>*/
+#if (MULTITHREAD>1) && USE_HARTS
+	__atomic_store_n(&harts_released, 1, __ATOMIC_RELEASE);
+#endif
 	p->portable_id=1;
 }
 /* Function: portable_fini
@@ -230,6 +262,21 @@ void portable_init(core_portable *p, int *argc, char *argv[])
 */
 void portable_fini(core_portable *p)
 {
+#if (MULTITHREAD>1) && USE_HARTS
+	/* Ticks are cycles, so iterations per million ticks are CoreMark/MHz */
+	ee_u32 i;
+	double rate, sum=0, total;
+	for (i=0; i<default_num_contexts; i++) {
+		rate=hart_ticks[i] ? hart_mailbox[i]->iterations*1e6/hart_ticks[i] : 0;
+		sum+=rate;
+		ee_printf("[%lu]ticks         : %lu\n",(unsigned long)i,(unsigned long)hart_ticks[i]);
+		ee_printf("[%lu]CoreMark/MHz  : %f\n",(unsigned long)i,rate);
+	}
+	total=get_time() ? default_num_contexts*(double)hart_mailbox[0]->iterations*1e6/get_time() : 0;
+	ee_printf("CoreMark/MHz     : %f\n",total);
+	if (sum>0)
+		ee_printf("Scaling          : %.1f%% of the sum over harts\n",100*total/sum);
+#endif
 	p->portable_id=0;
 }
 
@@ -344,6 +391,48 @@ ee_u8 core_stop_parallel(core_results *res) {
 	}
 	return 1;
 }
+#elif USE_HARTS
+/* Runs context res on hart, once all contexts have been handed out */
+static void hart_iterate(ee_u32 hart, core_results *res) {
+	CORETIMETYPE t0, t1;
+	__atomic_fetch_add(&harts_ready, 1, __ATOMIC_ACQ_REL);
+	while (__atomic_load_n(&harts_ready, __ATOMIC_ACQUIRE) < default_num_contexts)
+		;
+	GETMYTIME(&t0);
+	iterate(res);
+	GETMYTIME(&t1);
+	hart_ticks[hart]=(CORE_TICKS)(MYTIMEDIFF(t1,t0));
+	__atomic_store_n(&hart_done[hart], 1, __ATOMIC_RELEASE);
+}
+/* Function: hart_main
+	Entry point of harts 1..n-1 from crt0.S, on their own stacks.
+	Waits for the context from <core_start_parallel> and returns to crt0.S to park.
+*/
+void hart_main(ee_u32 hart) {
+	core_results *res;
+	if (hart>=MULTITHREAD)
+		return;
+	while ((res=__atomic_load_n(&hart_mailbox[hart], __ATOMIC_ACQUIRE))==NULL)
+		;
+	hart_iterate(hart, res);
+}
+/* Contexts go to harts in order. Hart 0 is busy calling these, so it runs
+   context 0 itself from core_stop_parallel, which core_main calls for
+   context 0 first, after all the contexts have been started. */
+static ee_u32 next_hart=0;
+ee_u8 core_start_parallel(core_results *res) {
+	res->port.hart=next_hart++;
+	__atomic_store_n(&hart_mailbox[res->port.hart], res, __ATOMIC_RELEASE);
+	return 0;
+}
+ee_u8 core_stop_parallel(core_results *res) {
+	ee_u32 hart=res->port.hart;
+	if (hart==0)
+		hart_iterate(0, res);
+	else while (!__atomic_load_n(&hart_done[hart], __ATOMIC_ACQUIRE))
+		;
+	return 0;
+}
 #else /* no standard multicore implementation */
 #error "Please implement multicore functionality in core_portme.c to use multiple contexts."
 #endif /* multithread implementations */
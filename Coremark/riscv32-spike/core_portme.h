@@ -198,6 +198,34 @@ typedef size_t ee_size_t;
 #define USE_SOCKET 0
 #endif
 
+/* Configuration: USE_HARTS
+	Bare-metal implementation for launching parallel contexts
+	Context i runs on hart i (spike -p<n>), hart 0 being the one running main.
+	The other harts wait in crt0.S until portable_init, then take their contexts
+	from <core_start_parallel>. See core_portme.c.
+	Valid values:
+	0 - Do not use harts.
+	1 - Use harts
+	Note:
+	This flag only matters if MULTITHREAD has been defined to a value greater then 1.
+	The simulation must have at least MULTITHREAD harts.
+*/
+#ifndef USE_HARTS
+#define USE_HARTS 1
+#endif
+
+/* Configuration: CORE_KERNELS
+	Count cycles separately for the list, matrix and state benchmarks and the CRC helpers.
+	Set by building with KERNELS=1, which also wraps these functions at link time. See core_kernels.c.
+
+	Valid values:
+	0 - Only count the timed region as a whole (default).
+	1 - Also count per kernel. The wrappers add to the timed region.
+*/
+#ifndef CORE_KERNELS
+#define CORE_KERNELS 0
+#endif
+
 /* Configuration: MAIN_HAS_NOARGC
 	Needed if platform does not support getting arguments to main.
 
@@ -254,6 +282,8 @@ extern ee_u32 default_num_contexts;
 	#include <unistd.h>
 	#include <errno.h>
 	#define PARALLEL_METHOD "Sockets"
+#elif USE_HARTS
+	#define PARALLEL_METHOD "Harts"
 #else
 	#define PARALLEL_METHOD "Proprietary"
 	#error "Please implement multicore functionality in core_portme.c to use multiple contexts."
@@ -272,6 +302,8 @@ typedef struct CORE_PORTABLE_S {
 	pid_t pid;
 	int sock;
 	struct sockaddr_in sa;
+	#elif USE_HARTS
+	ee_u8 hart;
 	#endif /* Method for multithreading */
 #endif /* MULTITHREAD>1 */
 	ee_u8	portable_id;
@@ -281,6 +313,12 @@ typedef struct CORE_PORTABLE_S {
 void portable_init(core_portable *p, int *argc, char *argv[]);
 void portable_fini(core_portable *p);
 
+#if CORE_KERNELS
+/* per-kernel counts over the timed region, see core_kernels.c */
+void kernels_start(void);
+void kernels_stop(void);
+#endif
+
 #if (SEED_METHOD==SEED_VOLATILE)
  #if (VALIDATION_RUN || PERFORMANCE_RUN || PROFILE_RUN)
   #define RUN_TYPE_FLAG 1
@@ -35,6 +35,13 @@ OUTFLAG= -o
 #	Use this flag to define compiler options. Note, you can add compiler options from the command line using XCFLAGS="other flags"
 #PORT_CFLAGS = -O2 -static -std=gnu99
 PORT_CFLAGS = $(USER_FLAGS) -march=rv32imafdc -mabi=ilp32d -DSPIKE -g
+# Flag: KERNELS
+#	Use KERNELS=1 to count the list, matrix and state benchmarks and the CRC helpers separately, see core_kernels.c.
+#	Their calls are wrapped at link time, so the benchmark sources stay unmodified.
+ifeq ($(KERNELS),1)
+PORT_CFLAGS += -DCORE_KERNELS=1
+KERNELS_LFLAGS = -Wl,--wrap=core_bench_list,--wrap=core_bench_matrix,--wrap=core_bench_state,--wrap=crc16,--wrap=crcu16,--wrap=crcu32
+endif
 FLAGS_STR = "$(PORT_CFLAGS) $(XCFLAGS) $(XLFLAGS) $(LFLAGS_END)"
 CFLAGS = $(PORT_CFLAGS) -I$(PORT_DIR) -I. -DFLAGS_STR=\"$(FLAGS_STR)\"
 #Flag: LFLAGS_END
@@ -74,12 +81,12 @@ ifdef SEPARATE_COMPILE
 
 LD		= $(CC)
 OBJOUT 	= -o
-LFLAGS 	= $(LFLAGS_EXTRA) -T$(PORT_DIR)/vanilla-spike.ld -mabi=ilp32d
+LFLAGS 	= $(LFLAGS_EXTRA) $(KERNELS_LFLAGS) -T$(PORT_DIR)/vanilla-spike.ld -mabi=ilp32d
 OFLAG 	= -o
 COUT 	= -c
 # Flag: PORT_OBJS
 # Port specific object files can be added here
-PORT_OBJS = $(PORT_DIR)/core_portme$(OEXT) $(PORT_DIR)/stub$(OEXT) $(PORT_DIR)/util$(OEXT) $(PORT_DIR)/htif$(OEXT) $(PORT_DIR)/crt0$(OEXT)
+PORT_OBJS = $(PORT_DIR)/core_portme$(OEXT) $(PORT_DIR)/core_kernels$(OEXT) $(PORT_DIR)/stub$(OEXT) $(PORT_DIR)/util$(OEXT) $(PORT_DIR)/htif$(OEXT) $(PORT_DIR)/crt0$(OEXT)
 PORT_CLEAN = *$(OEXT)
 
 $(OPATH)%$(OEXT) : %.S
@@ -89,27 +96,12 @@ endif
 
 # Target: port_prebuild
 # Generate any files that are needed before actual build starts.
-# E.g. generate profile guidance files. Sample PGO generation for gcc enabled with PGO=1
-#  - First, check if PGO was defined on the command line, if so, need to add -fprofile-use to compile line.
-#  - Second, if PGO reference has not yet been generated, add a step to the prebuild that will build a profile-generate version and run it.
-#  Note - Using REBUILD=1
-#
-# Use make PGO=1 to invoke this sample processing.
-
-ifdef PGO
- ifeq (,$(findstring $(PGO),gen))
-  PGO_STAGE=build_pgo_gcc
-  CFLAGS+=-fprofile-use
- endif
- PORT_CLEAN+=*.gcda *.gcno gmon.out
-endif
+# Profile guided builds are not done here: the instrumented binary has to run
+# on Spike, which the harness does. It passes the profile flags in CFLAGS, see
+# Runner.set_pgo() in run_all.py and common/pgo_dump.h.
 
 .PHONY: port_prebuild
-port_prebuild: $(PGO_STAGE)
-
-.PHONY: build_pgo_gcc
-build_pgo_gcc:
-	$(MAKE) PGO=gen XCFLAGS="$(XCFLAGS) -fprofile-generate -DTOTAL_DATA_SIZE=1200" ITERATIONS=10 gen_pgo_data REBUILD=1
+port_prebuild:
 
 # Target: port_postbuild
 # Generate any files that are needed after actual build end.
@@ -3,8 +3,12 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define SYS_exit 93
+#define SYS_openat 56
+#define SYS_close 57
+#define SYS_lseek 62
 #define SYS_read 63
 #define SYS_write 64
 
@@ -13,3 +17,20 @@ uintptr_t syscall(uintptr_t n, uintptr_t a0, uintptr_t a1, uintptr_t a2,
 
 void shutdown(int code);
 
+/* Host file access through the simulator's syscall proxy. Paths are relative
+   to the simulator's working directory, errors come back as -errno. The
+   proxy hands the flags to the host's openat() as they are, so they are
+   Linux's, see stub.c for newlib's. */
+#define HTIF_O_RDONLY 00
+#define HTIF_O_WRONLY 01
+#define HTIF_O_RDWR   02
+#define HTIF_O_CREAT  0100
+#define HTIF_O_EXCL   0200
+#define HTIF_O_TRUNC  01000
+#define HTIF_O_APPEND 02000
+int htif_open(const char *path, int flags, int mode);
+int htif_close(int fd);
+long htif_read(int fd, void *buf, size_t len);
+long htif_write(int fd, const void *buf, size_t len);
+long htif_lseek(int fd, long offset, int whence);
+
@@ -4,6 +4,7 @@
 
 #include "util.h"
 #include "htif.h"
+#include "../../common/pgo_dump.h"
 
 extern volatile uint64_t tohost;
 extern volatile uint64_t fromhost;
@@ -18,6 +19,10 @@ void printn(const char *s, int len) {
 
 void __attribute__((noreturn)) tohost_exit(uintptr_t code)
 {
+#if PGO_DUMP
+  if (code == 0)
+    pgo_dump();
+#endif
   tohost = (code << 1) | 1;
   while (1);
 }
@@ -2,7 +2,33 @@ set -e
 
 rm -f *.log
 mkdir -p build
-C_ASM_FLAGS="-march=rv32imafdc -mabi=ilp32d -ffunction-sections -fdata-sections $CFLAGS"
-cmake -B build -DPORT_DIR=ports/riscv -GNinja -DCMAKE_C_COMPILER="$CC" -DCMAKE_ASM_COMPILER="$CC" -DCMAKE_C_FLAGS="$C_ASM_FLAGS" -DCMAKE_ASM_FLAGS="$C_ASM_FLAGS" -DCMAKE_EXE_LINKER_FLAGS="-march=rv32imafdc -mabi=ilp32d -Wl,--gc-sections $LDFLAGS"
+# AUDIOMARK_PORT=riscv-v selects the RVV port, see ports/riscv-v
+PORT=${AUDIOMARK_PORT:-riscv}
+# AUDIOMARK_NN=rvv|cmsis picks the KWS NN kernels of the riscv-v port, see
+# ports/riscv-v/port.cmake. Always passed to that port, an earlier choice
+# would otherwise stick in the CMake cache.
+case "$PORT" in
+    riscv-v) MARCH=rv32imafdcv; ISA=rv32gcv; PORT_OPTS="-DTH_NN=${AUDIOMARK_NN:-rvv}" ;;
+    *) MARCH=rv32imafdc; ISA=rv32gc; PORT_OPTS= ;;
+esac
+C_ASM_FLAGS="-march=$MARCH -mabi=ilp32d -ffunction-sections -fdata-sections $CFLAGS"
+# Warm-state measurement and a shorter input clip, see main.c and ee_data.h
+C_ASM_FLAGS="$C_ASM_FLAGS ${AUDIOMARK_ITERATIONS:+-DAUDIOMARK_ITERATIONS=$AUDIOMARK_ITERATIONS}"
+C_ASM_FLAGS="$C_ASM_FLAGS ${AUDIOMARK_INPUT_SAMPLES:+-DAUDIOMARK_INPUT_SAMPLES=$AUDIOMARK_INPUT_SAMPLES}"
+# AUDIOMARK_INSTANCES=n runs n pipelines, one per hart, see main.c
+HARTS=${AUDIOMARK_INSTANCES:-1}
+C_ASM_FLAGS="$C_ASM_FLAGS -DAUDIOMARK_INSTANCES=$HARTS"
+# AUDIOMARK_STREAM=1 reads the input from WAV files at run time, see ports/riscv/th_stream.c
+if [ "${AUDIOMARK_STREAM:-0}" != "0" ]; then
+    C_ASM_FLAGS="$C_ASM_FLAGS -DAUDIOMARK_STREAM"
+    SIM_INPUTS="src/ee_data/wav/Noise.wav src/ee_data/wav/left0.wav src/ee_data/wav/right0.wav"
+fi
+# AUDIOMARK_FFT=smallft|kiss|cmsis picks SpeeX's FFT, see ports/riscv/port.cmake.
+cmake -B build -DPORT_DIR=ports/$PORT -DSPEEX_FFT=${AUDIOMARK_FFT:-smallft} $PORT_OPTS -GNinja -DCMAKE_C_COMPILER="$CC" -DCMAKE_ASM_COMPILER="$CC" -DCMAKE_C_FLAGS="$C_ASM_FLAGS" -DCMAKE_ASM_FLAGS="$C_ASM_FLAGS" -DCMAKE_EXE_LINKER_FLAGS="-march=$MARCH -mabi=ilp32d -Wl,--gc-sections $LDFLAGS" -DCMAKE_C_COMPILER_LAUNCHER="$CC_LAUNCHER" -DCMAKE_C_LINKER_LAUNCHER="$CC_LAUNCHER"
 ninja -vC build
-script '-c' 'spike --isa=rv32gc build/audiomark' '-e' > run.log
+# The harness simulates by itself, see run_all.py
+if [ "$1" = "--no-run" ]; then
+    exit 0
+fi
+# SIM_LAUNCHER is optional, see sim_cache.py
+${SIM_LAUNCHER:+$SIM_LAUNCHER build/audiomark $SIM_INPUTS --} script '-c' "spike -p$HARTS --isa=$ISA build/audiomark" '-e' > run.log
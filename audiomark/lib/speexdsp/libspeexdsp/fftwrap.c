@@ -351,17 +351,6 @@ void spx_ifft(void *table, spx_word16_t *in, spx_word16_t *out)
    kiss_fftri2(t->backward, in, out);
 }
 
-void spx_fft(void *table, spx_word16_t *in, spx_word16_t *out)
-{
-   int i;
-   float scale;
-   struct kiss_config *t = (struct kiss_config *)table;
-   scale = 1./t->N;
-   kiss_fftr2(t->forward, in, out);
-   for (i=0;i<t->N;i++)
-      out[i] *= scale;
-}
-
 #elif defined(USE_CMSIS_DSP)
 #include "arm_math.h"
 
@@ -389,8 +378,14 @@ void *spx_fft_init(int size)
    struct cmsis_fft_config *table;
    table = (struct cmsis_fft_config*)speex_alloc(sizeof(struct cmsis_fft_config));
    speex_assert(table != NULL)
+#ifdef FIXED_POINT
    table->scratchIn = (spx_word16_t *)speex_alloc(size * 2 * sizeof(spx_word16_t));
    table->scratchOut = (spx_word16_t *)speex_alloc(size * 2 * sizeof(spx_word16_t));
+#else
+   /* rfft_fast packs its output into N floats, keeps the instance inside the AEC/ANR heaps */
+   table->scratchIn = (spx_word16_t *)speex_alloc(size * sizeof(spx_word16_t));
+   table->scratchOut = (spx_word16_t *)speex_alloc(size * sizeof(spx_word16_t));
+#endif
    speex_assert(table->scratchIn != NULL);
    speex_assert(table->scratchOut != NULL);
 
@@ -44,6 +44,12 @@
  */
 #include "filterbank_opt_helium.c"
 
+#elif defined (__riscv_vector)
+/*
+ * RISC-V with the V extension
+ */
+#include "filterbank_opt_rvv.c"
+
 #elif defined (OTHER_ARCH)
 /*
  * More architectures to be added
@@ -0,0 +1,81 @@
+/* Copyright (C) 2023 HighTec EDV-Systeme GmbH
+
+   File: filterbank_opt_rvv.c
+   RISC-V Vector (RVV 1.0) version of the filterbank hooks
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+/* RISC-V Vector optimized parts */
+
+/*
+ * Only the mel to linear interpolation is vectorized, with indexed loads.
+ * filterbank_compute_bank32 scatters into mel[] with colliding indices, so
+ * it stays on the reference code.
+ */
+
+#include <riscv_vector.h>
+
+#if defined(FLOATING_POINT)
+
+#define OVERRIDE_FB_COMPUTE_PSD16
+
+void filterbank_compute_psd16(FilterBank * bank, spx_word16_t * mel, spx_word16_t * ps)
+{
+    const int      *bank_left = bank->bank_left;
+    const int      *bank_right = bank->bank_right;
+    const spx_word16_t *filter_left = bank->filter_left;
+    const spx_word16_t *filter_right = bank->filter_right;
+    size_t          vl;
+
+    for (int n = bank->len; n > 0; n -= vl) {
+        vl = __riscv_vsetvl_e32m8(n);
+        /* byte offsets into mel[] */
+        vuint32m8_t     id1 = __riscv_vsll_vx_u32m8(__riscv_vle32_v_u32m8((const uint32_t *) bank_left, vl), 2, vl);
+        vuint32m8_t     id2 = __riscv_vsll_vx_u32m8(__riscv_vle32_v_u32m8((const uint32_t *) bank_right, vl), 2, vl);
+        vfloat32m8_t    tmp = __riscv_vfmul_vv_f32m8(__riscv_vluxei32_v_f32m8(mel, id1, vl),
+                                                     __riscv_vle32_v_f32m8(filter_left, vl), vl);
+        tmp = __riscv_vfmacc_vv_f32m8(tmp, __riscv_vluxei32_v_f32m8(mel, id2, vl),
+                                      __riscv_vle32_v_f32m8(filter_right, vl), vl);
+        __riscv_vse32_v_f32m8(ps, tmp, vl);
+
+        bank_left += vl;
+        bank_right += vl;
+        filter_left += vl;
+        filter_right += vl;
+        ps += vl;
+    }
+}
+
+#else
+
+/* FIXED_POINT not needed for EEMBC AudioMark */
+#error "Fixed Point Filterbank RVV Optimization is not available"
+
+#endif
@@ -45,6 +45,12 @@
  */
 #include "mdf_opt_helium.c"
 
+#elif defined (__riscv_vector)
+/*
+ * RISC-V with the V extension
+ */
+#include "mdf_opt_rvv.c"
+
 #elif defined (OTHER_ARCH)
 /*
  * More architectures to be added
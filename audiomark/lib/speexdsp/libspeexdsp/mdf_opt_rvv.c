@@ -0,0 +1,400 @@
+/* Copyright (C) 2023 HighTec EDV-Systeme GmbH
+
+   File: mdf_opt_rvv.c
+   RISC-V Vector (RVV 1.0) versions of the MDF echo canceller hooks
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+/* RISC-V Vector optimized parts */
+
+/*
+ * Selected by __riscv_vector alone, so unlike the Helium backend the
+ * overrides are switched on here and not by the build. All loops are vector
+ * length agnostic. The recursive filters (DC notch, de-emphasis) and the
+ * pre-emphasis stay on the reference code.
+ */
+
+#include <riscv_vector.h>
+
+#if defined(FLOATING_POINT)
+
+#define OVERRIDE_MDF_INNER_PROD
+#define OVERRIDE_MDF_POWER_SPECTRUM
+#define OVERRIDE_MDF_POWER_SPECTRUM_ACCUM
+#define OVERRIDE_MDF_SPECTRAL_MUL_ACCUM
+#define OVERRIDE_MDF_WEIGHT_SPECT_MUL_CONJ
+#define OVERRIDE_MDF_ADJUST_PROP
+#define OVERRIDE_MDF_VEC_SUB
+#define OVERRIDE_MDF_VEC_SUB_INT16
+#define OVERRIDE_MDF_VEC_ADD
+#define OVERRIDE_MDF_VEC_MULT
+#define OVERRIDE_MDF_VEC_SCALE
+#define OVERRIDE_MDF_SMOOTHED_ADD
+#define OVERRIDE_MDF_SMOOTH_FE_NRG
+#define OVERRIDE_MDF_FILTERED_SPEC_AD_XCORR
+#define OVERRIDE_MDF_NORM_LEARN_RATE_CALC
+#define OVERRIDE_MDF_CONVERG_LEARN_RATE_CALC
+
+#define VISIB_ATTR static
+//#define VISIB_ATTR __attribute__ ((noinline))
+
+
+/* Sum of squares (x == y) or dot product, over an even number of samples */
+VISIB_ATTR spx_word32_t mdf_inner_prod(const spx_word16_t * x, const spx_word16_t * y, int len)
+{
+    size_t          vlmax = __riscv_vsetvlmax_e32m8();
+    vfloat32m8_t    acc = __riscv_vfmv_v_f_f32m8(0.0f, vlmax);
+    size_t          vl;
+
+    /* the reference code works on pairs and drops an odd sample */
+    for (len &= ~1; len > 0; len -= vl, x += vl, y += vl) {
+        vl = __riscv_vsetvl_e32m8(len);
+        acc = __riscv_vfmacc_vv_f32m8_tu(acc, __riscv_vle32_v_f32m8(x, vl), __riscv_vle32_v_f32m8(y, vl), vl);
+    }
+    return __riscv_vfmv_f_s_f32m1_f32(__riscv_vfredusum_vs_f32m8_f32m1(acc, __riscv_vfmv_s_f_f32m1(0.0f, 1), vlmax));
+}
+
+
+/* Half-complex layout: X[0] is DC, X[N-1] Nyquist, the pairs in between are
+   (re, im) of bins 1..N/2-1. The vector loops work on those pairs. */
+
+VISIB_ATTR void power_spectrum(const spx_word16_t * X, spx_word32_t * ps, int N)
+{
+    size_t          vl;
+
+    ps[0] = X[0] * X[0];
+    ps[N / 2] = X[N - 1] * X[N - 1];
+
+    X += 1;
+    ps += 1;
+    for (int n = N / 2 - 1; n > 0; n -= vl, X += 2 * vl, ps += vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        vfloat32m4x2_t  x = __riscv_vlseg2e32_v_f32m4x2(X, vl);
+        vfloat32m4_t    re = __riscv_vget_v_f32m4x2_f32m4(x, 0);
+        vfloat32m4_t    im = __riscv_vget_v_f32m4x2_f32m4(x, 1);
+        vfloat32m4_t    sq = __riscv_vfmul_vv_f32m4(re, re, vl);
+        __riscv_vse32_v_f32m4(ps, __riscv_vfmacc_vv_f32m4(sq, im, im, vl), vl);
+    }
+}
+
+/** Compute power spectrum of a half-complex (packed) vector and accumulate */
+VISIB_ATTR void power_spectrum_accum(const spx_word16_t * X, spx_word32_t * ps, int N)
+{
+    size_t          vl;
+
+    ps[0] += X[0] * X[0];
+    ps[N / 2] += X[N - 1] * X[N - 1];
+
+    X += 1;
+    ps += 1;
+    for (int n = N / 2 - 1; n > 0; n -= vl, X += 2 * vl, ps += vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        vfloat32m4x2_t  x = __riscv_vlseg2e32_v_f32m4x2(X, vl);
+        vfloat32m4_t    re = __riscv_vget_v_f32m4x2_f32m4(x, 0);
+        vfloat32m4_t    im = __riscv_vget_v_f32m4x2_f32m4(x, 1);
+        vfloat32m4_t    sq = __riscv_vfmul_vv_f32m4(re, re, vl);
+        sq = __riscv_vfmacc_vv_f32m4(sq, im, im, vl);
+        __riscv_vse32_v_f32m4(ps, __riscv_vfadd_vv_f32m4(__riscv_vle32_v_f32m4(ps, vl), sq, vl), vl);
+    }
+}
+
+/* The M blocks are summed per strip of bins, so the accumulators stay in
+   registers instead of going through acc[] once per block as in the
+   reference code. The summation order is the same. */
+VISIB_ATTR void spectral_mul_accum(const spx_word16_t * X, const spx_word32_t * Y, spx_word16_t * acc, int N, int M)
+{
+    spx_word32_t    acc_dc = 0, acc_ny = 0;
+    size_t          vl;
+    int             i, j;
+
+    for (j = 0; j < M; j++) {
+        acc_dc += X[j * N] * Y[j * N];
+        acc_ny += X[j * N + N - 1] * Y[j * N + N - 1];
+    }
+    acc[0] = acc_dc;
+    acc[N - 1] = acc_ny;
+
+    for (i = 1; i < N - 1; i += 2 * vl) {
+        vl = __riscv_vsetvl_e32m2((N - 1 - i) / 2);
+        vfloat32m2_t    re = __riscv_vfmv_v_f_f32m2(0.0f, vl);
+        vfloat32m2_t    im = __riscv_vfmv_v_f_f32m2(0.0f, vl);
+
+        for (j = 0; j < M; j++) {
+            vfloat32m2x2_t  x = __riscv_vlseg2e32_v_f32m2x2(X + j * N + i, vl);
+            vfloat32m2x2_t  y = __riscv_vlseg2e32_v_f32m2x2(Y + j * N + i, vl);
+            vfloat32m2_t    x_re = __riscv_vget_v_f32m2x2_f32m2(x, 0);
+            vfloat32m2_t    x_im = __riscv_vget_v_f32m2x2_f32m2(x, 1);
+            vfloat32m2_t    y_re = __riscv_vget_v_f32m2x2_f32m2(y, 0);
+            vfloat32m2_t    y_im = __riscv_vget_v_f32m2x2_f32m2(y, 1);
+
+            vfloat32m2_t    t = __riscv_vfmul_vv_f32m2(x_re, y_re, vl);
+            t = __riscv_vfnmsac_vv_f32m2(t, x_im, y_im, vl);
+            re = __riscv_vfadd_vv_f32m2(re, t, vl);
+            t = __riscv_vfmul_vv_f32m2(x_im, y_re, vl);
+            t = __riscv_vfmacc_vv_f32m2(t, x_re, y_im, vl);
+            im = __riscv_vfadd_vv_f32m2(im, t, vl);
+        }
+        __riscv_vsseg2e32_v_f32m2x2(acc + i, __riscv_vcreate_v_f32m2x2(re, im), vl);
+    }
+}
+
+VISIB_ATTR void weighted_spectral_mul_conj(const spx_float_t * w, const spx_float_t p, const spx_word16_t * X, const spx_word16_t * Y, spx_word32_t * prod, int N)
+{
+    size_t          vl;
+
+    prod[0] = (p * w[0]) * (X[0] * Y[0]);
+    prod[N - 1] = (p * w[N / 2]) * (X[N - 1] * Y[N - 1]);
+
+    /* one weight per bin, so w is read contiguously */
+    X += 1;
+    Y += 1;
+    w += 1;
+    prod += 1;
+    for (int n = N / 2 - 1; n > 0; n -= vl, X += 2 * vl, Y += 2 * vl, w += vl, prod += 2 * vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        vfloat32m4_t    W = __riscv_vfmul_vf_f32m4(__riscv_vle32_v_f32m4(w, vl), p, vl);
+        vfloat32m4x2_t  x = __riscv_vlseg2e32_v_f32m4x2(X, vl);
+        vfloat32m4x2_t  y = __riscv_vlseg2e32_v_f32m4x2(Y, vl);
+        vfloat32m4_t    x_re = __riscv_vget_v_f32m4x2_f32m4(x, 0);
+        vfloat32m4_t    x_im = __riscv_vget_v_f32m4x2_f32m4(x, 1);
+        vfloat32m4_t    y_re = __riscv_vget_v_f32m4x2_f32m4(y, 0);
+        vfloat32m4_t    y_im = __riscv_vget_v_f32m4x2_f32m4(y, 1);
+
+        /* conj(X) * Y */
+        vfloat32m4_t    re = __riscv_vfmul_vv_f32m4(x_re, y_re, vl);
+        re = __riscv_vfmacc_vv_f32m4(re, x_im, y_im, vl);
+        vfloat32m4_t    im = __riscv_vfmul_vv_f32m4(x_re, y_im, vl);
+        im = __riscv_vfnmsac_vv_f32m4(im, x_im, y_re, vl);
+
+        re = __riscv_vfmul_vv_f32m4(W, re, vl);
+        im = __riscv_vfmul_vv_f32m4(W, im, vl);
+        __riscv_vsseg2e32_v_f32m4x2(prod, __riscv_vcreate_v_f32m4x2(re, im), vl);
+    }
+}
+
+VISIB_ATTR void mdf_adjust_prop(const spx_word32_t * W, int N, int M, int P, spx_word16_t * prop)
+{
+    size_t          vlmax = __riscv_vsetvlmax_e32m8();
+    spx_word16_t    max_sum = 1;
+    spx_word32_t    prop_sum = 1;
+    int             i, p;
+
+    /* M is the number of blocks, a handful, only the sums of squares are
+       worth vectorizing */
+    for (i = 0; i < M; i++) {
+        vfloat32m8_t    acc = __riscv_vfmv_v_f_f32m8(0.0f, vlmax);
+        size_t          vl;
+
+        for (p = 0; p < P; p++) {
+            const spx_word32_t *pW = &W[p * N * M + i * N];
+            for (int n = N; n > 0; n -= vl, pW += vl) {
+                vl = __riscv_vsetvl_e32m8(n);
+                vfloat32m8_t    w = __riscv_vle32_v_f32m8(pW, vl);
+                acc = __riscv_vfmacc_vv_f32m8_tu(acc, w, w, vl);
+            }
+        }
+        spx_word32_t    tmp = __riscv_vfmv_f_s_f32m1_f32(__riscv_vfredusum_vs_f32m8_f32m1(acc, __riscv_vfmv_s_f_f32m1(1.0f, 1), vlmax));
+        prop[i] = spx_sqrt(tmp);
+        if (prop[i] > max_sum)
+            max_sum = prop[i];
+    }
+    for (i = 0; i < M; i++) {
+        prop[i] += MULT16_16_Q15(QCONST16(.1f, 15), max_sum);
+        prop_sum += EXTEND32(prop[i]);
+    }
+    for (i = 0; i < M; i++) {
+        prop[i] = DIV32(MULT16_16(QCONST16(.99f, 15), prop[i]), prop_sum);
+    }
+}
+
+VISIB_ATTR void vect_sub(const spx_word16_t * pSrcA, const spx_word16_t * pSrcB, spx_word16_t * pDst, uint32_t blockSize)
+{
+    size_t          vl;
+
+    for (; blockSize > 0; blockSize -= vl, pSrcA += vl, pSrcB += vl, pDst += vl) {
+        vl = __riscv_vsetvl_e32m8(blockSize);
+        vfloat32m8_t    a = __riscv_vle32_v_f32m8(pSrcA, vl);
+        vfloat32m8_t    b = __riscv_vle32_v_f32m8(pSrcB, vl);
+        __riscv_vse32_v_f32m8(pDst, __riscv_vfsub_vv_f32m8(a, b, vl), vl);
+    }
+}
+
+/* subtract spx_int16_t inputs => spx_word16_t dest */
+VISIB_ATTR void vect_sub16(const spx_int16_t * pSrcA, const spx_int16_t * pSrcB, spx_word16_t * pDst, uint32_t blockSize)
+{
+    size_t          vl;
+
+    for (; blockSize > 0; blockSize -= vl, pSrcA += vl, pSrcB += vl, pDst += vl) {
+        vl = __riscv_vsetvl_e16m4(blockSize);
+        vint32m8_t      d = __riscv_vwsub_vv_i32m8(__riscv_vle16_v_i16m4(pSrcA, vl), __riscv_vle16_v_i16m4(pSrcB, vl), vl);
+        __riscv_vse32_v_f32m8(pDst, __riscv_vfcvt_f_x_v_f32m8(d, vl), vl);
+    }
+}
+
+VISIB_ATTR void vect_add(const spx_word16_t * pSrcA, const spx_word16_t * pSrcB, spx_word16_t * pDst, uint32_t blockSize)
+{
+    size_t          vl;
+
+    for (; blockSize > 0; blockSize -= vl, pSrcA += vl, pSrcB += vl, pDst += vl) {
+        vl = __riscv_vsetvl_e32m8(blockSize);
+        vfloat32m8_t    a = __riscv_vle32_v_f32m8(pSrcA, vl);
+        vfloat32m8_t    b = __riscv_vle32_v_f32m8(pSrcB, vl);
+        __riscv_vse32_v_f32m8(pDst, __riscv_vfadd_vv_f32m8(a, b, vl), vl);
+    }
+}
+
+/* vector mult for windowing */
+VISIB_ATTR void vect_mult(const spx_word16_t * pSrcA, const spx_word16_t * pSrcB, spx_word16_t * pDst, uint32_t blockSize)
+{
+    size_t          vl;
+
+    for (; blockSize > 0; blockSize -= vl, pSrcA += vl, pSrcB += vl, pDst += vl) {
+        vl = __riscv_vsetvl_e32m8(blockSize);
+        vfloat32m8_t    a = __riscv_vle32_v_f32m8(pSrcA, vl);
+        vfloat32m8_t    b = __riscv_vle32_v_f32m8(pSrcB, vl);
+        __riscv_vse32_v_f32m8(pDst, __riscv_vfmul_vv_f32m8(a, b, vl), vl);
+    }
+}
+
+VISIB_ATTR void vect_scale(const spx_word16_t * pSrc, spx_word16_t scale, spx_word16_t * pDst, uint32_t blockSize)
+{
+    size_t          vl;
+
+    for (; blockSize > 0; blockSize -= vl, pSrc += vl, pDst += vl) {
+        vl = __riscv_vsetvl_e32m8(blockSize);
+        vfloat32m8_t    s = __riscv_vfmul_vf_f32m8(__riscv_vle32_v_f32m8(pSrc, vl), scale, vl);
+        /* the reference code truncates through spx_int32_t */
+        vint32m8_t      t = __riscv_vfcvt_rtz_x_f_v_i32m8(s, vl);
+        __riscv_vse32_v_f32m8(pDst, __riscv_vfcvt_f_x_v_f32m8(t, vl), vl);
+    }
+}
+
+VISIB_ATTR void smoothed_add(const spx_word16_t * pSrc1, const spx_word16_t * pWin1,
+                             const spx_word16_t * pSrc2, const spx_word16_t * pWin2, spx_word16_t * pDst, uint16_t frame_size, uint16_t nbChan, uint16_t N)
+{
+    for (int chan = 0; chan < nbChan; chan++) {
+        size_t          vl;
+
+        for (int i = 0; i < frame_size; i += vl) {
+            vl = __riscv_vsetvl_e32m4(frame_size - i);
+            vfloat32m4_t    acc = __riscv_vfmul_vv_f32m4(__riscv_vle32_v_f32m4(pWin1 + i, vl),
+                                                          __riscv_vle32_v_f32m4(pSrc1 + chan * N + i, vl), vl);
+            acc = __riscv_vfmacc_vv_f32m4(acc, __riscv_vle32_v_f32m4(pWin2 + i, vl),
+                                          __riscv_vle32_v_f32m4(pSrc2 + chan * N + i, vl), vl);
+            __riscv_vse32_v_f32m4(pDst + chan * N + i, acc, vl);
+        }
+    }
+}
+
+VISIB_ATTR void smooth_fe_nrg(spx_word32_t * in1, spx_word16_t c1, spx_word32_t * in2, spx_word16_t c2, spx_word32_t * pDst, uint16_t frame_size)
+{
+    size_t          vl;
+
+    for (int n = frame_size; n > 0; n -= vl, in1 += vl, in2 += vl, pDst += vl) {
+        vl = __riscv_vsetvl_e32m8(n);
+        vfloat32m8_t    d = __riscv_vfmul_vf_f32m8(__riscv_vle32_v_f32m8(in1, vl), c1, vl);
+        d = __riscv_vfadd_vf_f32m8(d, 1.0f, vl);
+        d = __riscv_vfmacc_vf_f32m8(d, c2, __riscv_vle32_v_f32m8(in2, vl), vl);
+        __riscv_vse32_v_f32m8(pDst, d, vl);
+    }
+}
+
+VISIB_ATTR void filtered_spectra_cross_corr(spx_word32_t * pRf, spx_word32_t * pEh, spx_word32_t * pYf, spx_word32_t * pYh,
+                                            spx_float_t * Pey, spx_float_t * Pyy, spx_word16_t spec_average, uint16_t frame_size)
+{
+    size_t          vlmax = __riscv_vsetvlmax_e32m4();
+    vfloat32m4_t    sum_ey = __riscv_vfmv_v_f_f32m4(0.0f, vlmax);
+    vfloat32m4_t    sum_yy = __riscv_vfmv_v_f_f32m4(0.0f, vlmax);
+    spx_word16_t    spec_average_1 = 1 - spec_average;
+    size_t          vl;
+
+    for (int n = frame_size; n > 0; n -= vl, pRf += vl, pEh += vl, pYf += vl, pYh += vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        vfloat32m4_t    rf = __riscv_vle32_v_f32m4(pRf, vl);
+        vfloat32m4_t    eh = __riscv_vle32_v_f32m4(pEh, vl);
+        vfloat32m4_t    yf = __riscv_vle32_v_f32m4(pYf, vl);
+        vfloat32m4_t    yh = __riscv_vle32_v_f32m4(pYh, vl);
+        vfloat32m4_t    de = __riscv_vfsub_vv_f32m4(rf, eh, vl);
+        vfloat32m4_t    dy = __riscv_vfsub_vv_f32m4(yf, yh, vl);
+
+        sum_ey = __riscv_vfmacc_vv_f32m4_tu(sum_ey, de, dy, vl);
+        sum_yy = __riscv_vfmacc_vv_f32m4_tu(sum_yy, dy, dy, vl);
+
+        eh = __riscv_vfmul_vf_f32m4(eh, spec_average_1, vl);
+        __riscv_vse32_v_f32m4(pEh, __riscv_vfmacc_vf_f32m4(eh, spec_average, rf, vl), vl);
+        yh = __riscv_vfmul_vf_f32m4(yh, spec_average_1, vl);
+        __riscv_vse32_v_f32m4(pYh, __riscv_vfmacc_vf_f32m4(yh, spec_average, yf, vl), vl);
+    }
+
+    vfloat32m1_t    zero = __riscv_vfmv_s_f_f32m1(0.0f, 1);
+    *Pey += __riscv_vfmv_f_s_f32m1_f32(__riscv_vfredusum_vs_f32m4_f32m1(sum_ey, zero, vlmax));
+    *Pyy += __riscv_vfmv_f_s_f32m1_f32(__riscv_vfredusum_vs_f32m4_f32m1(sum_yy, zero, vlmax));
+}
+
+VISIB_ATTR void mdf_nominal_learning_rate_calc(spx_word32_t * pRf, spx_word32_t * power,
+                                               spx_word32_t * pYf, spx_float_t * power_1, spx_word16_t leak_estimate, spx_word16_t RER, uint16_t frame_size)
+{
+    size_t          vl;
+
+    for (int n = frame_size; n > 0; n -= vl, pRf += vl, power += vl, pYf += vl, power_1 += vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        /* Compute frequency-domain adaptation mask */
+        vfloat32m4_t    r = __riscv_vfmul_vf_f32m4(__riscv_vle32_v_f32m4(pYf, vl), leak_estimate, vl);
+        vfloat32m4_t    e = __riscv_vfadd_vf_f32m4(__riscv_vle32_v_f32m4(pRf, vl), 1.0f, vl);
+
+        /* if (r > .5 * e) r = .5 * e; */
+        r = __riscv_vfmin_vv_f32m4(r, __riscv_vfmul_vf_f32m4(e, 0.5f, vl), vl);
+
+        r = __riscv_vfmul_vf_f32m4(r, 0.7f, vl);
+        r = __riscv_vfmacc_vf_f32m4(r, 0.3f, __riscv_vfmul_vf_f32m4(e, RER, vl), vl);
+
+        /*st->power_1[i] = adapt_rate*r/(e*(1+st->power[i])); */
+        vfloat32m4_t    d = __riscv_vfadd_vf_f32m4(__riscv_vle32_v_f32m4(power, vl), 10.0f, vl);
+        __riscv_vse32_v_f32m4(power_1, __riscv_vfdiv_vv_f32m4(r, __riscv_vfmul_vv_f32m4(e, d, vl), vl), vl);
+    }
+}
+
+VISIB_ATTR void mdf_non_adapt_learning_rate_calc(spx_word32_t * power, spx_float_t * power_1, spx_word16_t adapt_rate, uint16_t frame_size)
+{
+    size_t          vl;
+
+    for (int n = frame_size; n > 0; n -= vl, power += vl, power_1 += vl) {
+        vl = __riscv_vsetvl_e32m8(n);
+        vfloat32m8_t    d = __riscv_vfadd_vf_f32m8(__riscv_vle32_v_f32m8(power, vl), 10.0f, vl);
+        __riscv_vse32_v_f32m8(power_1, __riscv_vfrdiv_vf_f32m8(d, adapt_rate, vl), vl);
+    }
+}
+
+#else
+
+/* FIXED_POINT not needed for EEMBC AudioMark */
+#error "Fixed Point MDF RVV Optimization is not available"
+
+#endif
@@ -377,6 +377,11 @@ static inline spx_word16_t qcurve(spx_word16_t x)
 }
 #endif
 
+#if !defined (GENERIC_ARCH) && defined (__riscv_vector)
+/* Checked before preprocess_opt.c is included, see preprocess_opt_rvv.c */
+#define OVERRIDE_ANR_COMPUTE_GAIN_FLOOR
+#endif
+
 #ifndef OVERRIDE_ANR_COMPUTE_GAIN_FLOOR
 static void compute_gain_floor(int noise_suppress, int effective_echo_suppress, spx_word32_t *noise, spx_word32_t *echo, spx_word16_t *gain_floor, int len)
 {
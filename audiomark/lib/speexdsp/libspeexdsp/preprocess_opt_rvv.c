@@ -0,0 +1,319 @@
+/* Copyright (C) 2023 HighTec EDV-Systeme GmbH
+
+   File: preprocess_opt_rvv.c
+   RISC-V Vector (RVV 1.0) versions of the preprocessor (ANR) hooks
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+/* RISC-V Vector optimized parts */
+
+/*
+ * As for MDF, the overrides are switched on here. OVERRIDE_ANR_COMPUTE_GAIN_FLOOR
+ * is the exception, preprocess.c checks it before including this file and
+ * defines it itself for __riscv_vector. The gain updates (hypergeometric
+ * gain, exp()) stay on the reference code.
+ */
+
+#include <riscv_vector.h>
+
+#if defined(FLOATING_POINT)
+
+#define OVERRIDE_ANR_VEC_MUL
+#define OVERRIDE_ANR_OLA
+#define OVERRIDE_ANR_POWER_SPECTRUM
+#define OVERRIDE_ANR_UPDATE_NOISE_ESTIMATE
+#define OVERRIDE_ANR_APOSTERIORI_SNR
+#define OVERRIDE_ANR_UPDATE_ZETA
+#define OVERRIDE_ANR_APPLY_SPEC_GAIN
+#define OVERRIDE_ANR_UPDATE_NOISE_PROB
+
+#define VISIB_ATTR static
+//#define VISIB_ATTR __attribute__ ((noinline))
+
+
+/* vector mult for windowing */
+VISIB_ATTR void vect_mult(const spx_word16_t * pSrcA, const spx_word16_t * pSrcB, spx_word16_t * pDst, uint32_t blockSize)
+{
+    size_t          vl;
+
+    for (; blockSize > 0; blockSize -= vl, pSrcA += vl, pSrcB += vl, pDst += vl) {
+        vl = __riscv_vsetvl_e32m8(blockSize);
+        vfloat32m8_t    a = __riscv_vle32_v_f32m8(pSrcA, vl);
+        vfloat32m8_t    b = __riscv_vle32_v_f32m8(pSrcB, vl);
+        __riscv_vse32_v_f32m8(pDst, __riscv_vfmul_vv_f32m8(a, b, vl), vl);
+    }
+}
+
+/* vector overlap and add */
+VISIB_ATTR void vect_ola(const spx_word16_t * pSrcA, const spx_word16_t * pSrcB, spx_int16_t * pDst, uint32_t blockSize)
+{
+    size_t          vl;
+
+    for (; blockSize > 0; blockSize -= vl, pSrcA += vl, pSrcB += vl, pDst += vl) {
+        vl = __riscv_vsetvl_e32m8(blockSize);
+        vfloat32m8_t    x = __riscv_vfadd_vv_f32m8(__riscv_vle32_v_f32m8(pSrcA, vl), __riscv_vle32_v_f32m8(pSrcB, vl), vl);
+
+        /* WORD2INT() rounds with floor(.5 + x). Round to nearest even and
+           push the ties that went down back up, x - round(x) is exact. */
+        vint32m8_t      r = __riscv_vfcvt_x_f_v_i32m8_rm(x, __RISCV_FRM_RNE, vl);
+        vfloat32m8_t    d = __riscv_vfsub_vv_f32m8(x, __riscv_vfcvt_f_x_v_f32m8(r, vl), vl);
+        vbool4_t        tie = __riscv_vmfeq_vf_f32m8_b4(d, 0.5f, vl);
+        r = __riscv_vadd_vx_i32m8_mu(tie, r, r, 1, vl);
+
+        /* and saturates to 16 bits */
+        __riscv_vse16_v_i16m4(pDst, __riscv_vnclip_wx_i16m4(r, 0, __RISCV_VXRM_RNU, vl), vl);
+    }
+}
+
+VISIB_ATTR void compute_gain_floor(int noise_suppress, int effective_echo_suppress, spx_word32_t * noise, spx_word32_t * echo, spx_word16_t * gain_floor, int len)
+{
+    float           echo_floor;
+    float           noise_floor;
+    size_t          vl;
+
+    noise_floor = exp(.2302585f * noise_suppress);
+    echo_floor = exp(.2302585f * effective_echo_suppress);
+
+    /* Compute the gain floor based on different floors for the background noise and residual echo */
+    for (; len > 0; len -= vl, noise += vl, echo += vl, gain_floor += vl) {
+        vl = __riscv_vsetvl_e32m8(len);
+        vfloat32m8_t    n = __riscv_vle32_v_f32m8(noise, vl);
+        vfloat32m8_t    e = __riscv_vle32_v_f32m8(echo, vl);
+        vfloat32m8_t    num = __riscv_vfmul_vf_f32m8(n, noise_floor, vl);
+        num = __riscv_vfmacc_vf_f32m8(num, echo_floor, e, vl);
+        vfloat32m8_t    den = __riscv_vfadd_vv_f32m8(__riscv_vfadd_vf_f32m8(n, 1.0f, vl), e, vl);
+        /* one square root instead of two */
+        __riscv_vse32_v_f32m8(gain_floor, __riscv_vfsqrt_v_f32m8(__riscv_vfdiv_vv_f32m8(num, den, vl), vl), vl);
+    }
+}
+
+VISIB_ATTR void power_spectrum(spx_word16_t * ft, spx_word32_t * ps, int N)
+{
+    size_t          vl;
+
+    ps[0] = ft[0] * ft[0];
+
+    /* bins 1..N-1 are the (re, im) pairs from ft[1] on */
+    ft += 1;
+    ps += 1;
+    for (int n = N - 1; n > 0; n -= vl, ft += 2 * vl, ps += vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        vfloat32m4x2_t  x = __riscv_vlseg2e32_v_f32m4x2(ft, vl);
+        vfloat32m4_t    re = __riscv_vget_v_f32m4x2_f32m4(x, 0);
+        vfloat32m4_t    im = __riscv_vget_v_f32m4x2_f32m4(x, 1);
+        vfloat32m4_t    sq = __riscv_vfmul_vv_f32m4(re, re, vl);
+        __riscv_vse32_v_f32m4(ps, __riscv_vfmacc_vv_f32m4(sq, im, im, vl), vl);
+    }
+}
+
+VISIB_ATTR void update_noise_estimate(SpeexPreprocessState * st, spx_word16_t beta, spx_word16_t beta_1)
+{
+    const spx_word32_t *ps = st->ps;
+    const int      *update_prob = st->update_prob;
+    spx_word32_t   *noise = st->noise;
+    size_t          vl;
+
+    for (int n = st->ps_size; n > 0; n -= vl, ps += vl, update_prob += vl, noise += vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        vfloat32m4_t    p = __riscv_vle32_v_f32m4(ps, vl);
+        vfloat32m4_t    old = __riscv_vle32_v_f32m4(noise, vl);
+
+        /* !update_prob[i] || ps[i] < noise[i] */
+        vbool8_t        upd = __riscv_vmor_mm_b8(__riscv_vmseq_vx_i32m4_b8(__riscv_vle32_v_i32m4(update_prob, vl), 0, vl),
+                                                 __riscv_vmflt_vv_f32m4_b8(p, old, vl), vl);
+        vfloat32m4_t    upd_noise = __riscv_vfmul_vf_f32m4(old, beta_1, vl);
+        upd_noise = __riscv_vfmacc_vf_f32m4(upd_noise, beta, p, vl);
+        upd_noise = __riscv_vfmax_vf_f32m4(upd_noise, 0.0f, vl);
+        __riscv_vse32_v_f32m4(noise, __riscv_vmerge_vvm_f32m4(old, upd_noise, upd, vl), vl);
+    }
+}
+
+VISIB_ATTR void aposteriori_snr(SpeexPreprocessState * st)
+{
+    const spx_word32_t *ps = st->ps;
+    const spx_word32_t *noise = st->noise;
+    const spx_word32_t *echo_noise = st->echo_noise;
+    const spx_word32_t *reverb_estimate = st->reverb_estimate;
+    const spx_word32_t *old_ps = st->old_ps;
+    spx_word16_t   *post = st->post;
+    spx_word16_t   *prior = st->prior;
+    size_t          vl;
+
+    for (int n = st->ps_size + st->nbands; n > 0; n -= vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        vfloat32m4_t    p = __riscv_vle32_v_f32m4(ps, vl);
+        vfloat32m4_t    old = __riscv_vle32_v_f32m4(old_ps, vl);
+
+        /* Total noise estimate including residual echo and reverberation */
+        vfloat32m4_t    tot_noise = __riscv_vfadd_vf_f32m4(__riscv_vle32_v_f32m4(noise, vl), 1.0f, vl);
+        tot_noise = __riscv_vfadd_vv_f32m4(tot_noise, __riscv_vle32_v_f32m4(echo_noise, vl), vl);
+        tot_noise = __riscv_vfadd_vv_f32m4(tot_noise, __riscv_vle32_v_f32m4(reverb_estimate, vl), vl);
+
+        /* A posteriori SNR = ps/noise - 1 */
+        vfloat32m4_t    vpost = __riscv_vfsub_vf_f32m4(__riscv_vfdiv_vv_f32m4(p, tot_noise, vl), 1.0f, vl);
+        vpost = __riscv_vfmin_vf_f32m4(vpost, 100.0f, vl);
+        __riscv_vse32_v_f32m4(post, vpost, vl);
+
+        /* Computing update gamma = .1 + .9*(old/(old+noise))^2 */
+        vfloat32m4_t    ratio = __riscv_vfdiv_vv_f32m4(old, __riscv_vfadd_vv_f32m4(old, tot_noise, vl), vl);
+        vfloat32m4_t    gamma = __riscv_vfmul_vv_f32m4(ratio, ratio, vl);
+        gamma = __riscv_vfmadd_vf_f32m4(gamma, .89f, __riscv_vfmv_v_f_f32m4(.1f, vl), vl);
+
+        /* A priori SNR update = gamma*max(0,post) + (1-gamma)*old/noise */
+        vfloat32m4_t    vprior = __riscv_vfmul_vv_f32m4(gamma, __riscv_vfmax_vf_f32m4(vpost, 0.0f, vl), vl);
+        vprior = __riscv_vfmacc_vv_f32m4(vprior, __riscv_vfrsub_vf_f32m4(gamma, 1.0f, vl),
+                                         __riscv_vfdiv_vv_f32m4(old, tot_noise, vl), vl);
+        __riscv_vse32_v_f32m4(prior, __riscv_vfmin_vf_f32m4(vprior, 100.0f, vl), vl);
+
+        ps += vl;
+        noise += vl;
+        echo_noise += vl;
+        reverb_estimate += vl;
+        old_ps += vl;
+        post += vl;
+        prior += vl;
+    }
+}
+
+VISIB_ATTR void preprocess_update_zeta(SpeexPreprocessState * st)
+{
+    int             N = st->ps_size;
+    int             M = st->nbands;
+    spx_word16_t   *zeta = st->zeta;
+    const spx_word16_t *prior = st->prior;
+    size_t          vl;
+    int             i;
+
+    zeta[0] = .7f * zeta[0] + .3f * prior[0];
+
+    /* smoothed over the neighbouring bins */
+    for (i = 1; i < N - 1; i += vl) {
+        vl = __riscv_vsetvl_e32m4(N - 1 - i);
+        vfloat32m4_t    z = __riscv_vfmul_vf_f32m4(__riscv_vle32_v_f32m4(zeta + i, vl), .7f, vl);
+        z = __riscv_vfmacc_vf_f32m4(z, .15f, __riscv_vle32_v_f32m4(prior + i, vl), vl);
+        z = __riscv_vfmacc_vf_f32m4(z, .075f, __riscv_vle32_v_f32m4(prior + i - 1, vl), vl);
+        z = __riscv_vfmacc_vf_f32m4(z, .075f, __riscv_vle32_v_f32m4(prior + i + 1, vl), vl);
+        __riscv_vse32_v_f32m4(zeta + i, z, vl);
+    }
+    for (i = N - 1; i < N + M; i += vl) {
+        vl = __riscv_vsetvl_e32m4(N + M - i);
+        vfloat32m4_t    z = __riscv_vfmul_vf_f32m4(__riscv_vle32_v_f32m4(zeta + i, vl), .7f, vl);
+        z = __riscv_vfmacc_vf_f32m4(z, .3f, __riscv_vle32_v_f32m4(prior + i, vl), vl);
+        __riscv_vse32_v_f32m4(zeta + i, z, vl);
+    }
+}
+
+VISIB_ATTR void apply_spectral_gain(SpeexPreprocessState * st)
+{
+    int             N = st->ps_size;
+    spx_word16_t   *ft = st->ft + 1;
+    const spx_word16_t *gain2 = st->gain2 + 1;
+    size_t          vl;
+
+    /* the (re, im) pair of bin i shares gain2[i] */
+    for (int n = N - 1; n > 0; n -= vl, ft += 2 * vl, gain2 += vl) {
+        vl = __riscv_vsetvl_e32m4(n);
+        vfloat32m4_t    g = __riscv_vle32_v_f32m4(gain2, vl);
+        vfloat32m4x2_t  x = __riscv_vlseg2e32_v_f32m4x2(ft, vl);
+        vfloat32m4_t    re = __riscv_vfmul_vv_f32m4(g, __riscv_vget_v_f32m4x2_f32m4(x, 0), vl);
+        vfloat32m4_t    im = __riscv_vfmul_vv_f32m4(g, __riscv_vget_v_f32m4x2_f32m4(x, 1), vl);
+        __riscv_vsseg2e32_v_f32m4x2(ft, __riscv_vcreate_v_f32m4x2(re, im), vl);
+    }
+    st->ft[0] = st->gain2[0] * st->ft[0];
+    st->ft[2 * N - 1] = st->gain2[N - 1] * st->ft[2 * N - 1];
+}
+
+VISIB_ATTR void update_noise_prob(SpeexPreprocessState * st)
+{
+    int             i;
+    int             min_range;
+    int             N = st->ps_size;
+    spx_word32_t   *S = st->S;
+    const spx_word32_t *ps = st->ps;
+    size_t          vl;
+
+    for (i = 1; i < N - 1; i += vl) {
+        vl = __riscv_vsetvl_e32m4(N - 1 - i);
+        vfloat32m4_t    s = __riscv_vfmul_vf_f32m4(__riscv_vle32_v_f32m4(S + i, vl), .8f, vl);
+        s = __riscv_vfmacc_vf_f32m4(s, .05f, __riscv_vle32_v_f32m4(ps + i - 1, vl), vl);
+        s = __riscv_vfmacc_vf_f32m4(s, .1f, __riscv_vle32_v_f32m4(ps + i, vl), vl);
+        s = __riscv_vfmacc_vf_f32m4(s, .05f, __riscv_vle32_v_f32m4(ps + i + 1, vl), vl);
+        __riscv_vse32_v_f32m4(S + i, s, vl);
+    }
+    S[0] = .8f * S[0] + .2f * ps[0];
+    S[N - 1] = .8f * S[N - 1] + .2f * ps[N - 1];
+
+    if (st->nb_adapt == 1) {
+        for (i = 0; i < N; i++)
+            st->Smin[i] = st->Stmp[i] = 0;
+    }
+
+    if (st->nb_adapt < 100)
+        min_range = 15;
+    else if (st->nb_adapt < 1000)
+        min_range = 50;
+    else if (st->nb_adapt < 10000)
+        min_range = 150;
+    else
+        min_range = 300;
+
+    int             reset = st->min_count > min_range;
+    if (reset)
+        st->min_count = 0;
+
+    for (i = 0; i < N; i += vl) {
+        vl = __riscv_vsetvl_e32m4(N - i);
+        vfloat32m4_t    s = __riscv_vle32_v_f32m4(S + i, vl);
+        vfloat32m4_t    stmp = __riscv_vle32_v_f32m4(st->Stmp + i, vl);
+        vfloat32m4_t    smin;
+
+        if (reset) {
+            smin = __riscv_vfmin_vv_f32m4(stmp, s, vl);
+            stmp = s;
+        } else {
+            smin = __riscv_vfmin_vv_f32m4(__riscv_vle32_v_f32m4(st->Smin + i, vl), s, vl);
+            stmp = __riscv_vfmin_vv_f32m4(stmp, s, vl);
+        }
+        __riscv_vse32_v_f32m4(st->Smin + i, smin, vl);
+        __riscv_vse32_v_f32m4(st->Stmp + i, stmp, vl);
+
+        /* update_prob = .4 * S > Smin */
+        vbool8_t        upd = __riscv_vmfgt_vv_f32m4_b8(__riscv_vfmul_vf_f32m4(s, .4f, vl), smin, vl);
+        __riscv_vse32_v_i32m4(st->update_prob + i,
+                              __riscv_vmerge_vxm_i32m4(__riscv_vmv_v_x_i32m4(0, vl), 1, upd, vl), vl);
+    }
+}
+
+#else
+
+/* FIXED_POINT not needed for EEMBC AudioMark */
+#error "Fixed Point Preprocess RVV Optimization is not available"
+
+#endif
@@ -29,11 +29,23 @@
 #endif
 #elif defined __riscv
 extern uint64_t get_system_us();
+extern void start_trigger();
+extern void stop_trigger();
 #else
 #error "Operating system not recognized"
 #endif
 #include <assert.h>
 
+#ifdef SPIKE
+/* Iterations to run on Spike. With more than one, the first only warms up
+   (KWS FIFO fill, FFT setup) and 2..N are measured. */
+#ifndef AUDIOMARK_ITERATIONS
+#define AUDIOMARK_ITERATIONS 1
+#endif
+#if AUDIOMARK_ITERATIONS < 1
+#error "AUDIOMARK_ITERATIONS must be at least 1"
+#endif
+#endif
 
 
 uint64_t
@@ -62,7 +74,7 @@ th_microseconds(void)
 }
 
 bool
-time_audiomark_run(uint32_t iterations, uint64_t *dt)
+time_audiomark_run(uint32_t instance, uint32_t iterations, uint64_t *dt)
 {
     uint64_t t0  = 0;
     uint64_t t1  = 0;
@@ -71,7 +83,7 @@ time_audiomark_run(uint32_t iterations, uint64_t *dt)
     t0 = th_microseconds();
     for (uint32_t i = 0; i < iterations; ++i)
     {
-        if (ee_audiomark_run())
+        if (ee_audiomark_run(instance))
         {
             err = true;
             break;
@@ -82,6 +94,196 @@ time_audiomark_run(uint32_t iterations, uint64_t *dt)
     return err;
 }
 
+#if defined SPIKE && AUDIOMARK_ITERATIONS > 1
+static uint64_t iteration_dt[AUDIOMARK_ITERATIONS - 1];
+
+/* Like time_audiomark_run, but with an unmeasured first iteration and the
+   time of each measured iteration printed afterwards. */
+bool
+time_audiomark_warm(uint32_t iterations, uint64_t *dt)
+{
+    uint64_t t0  = 0;
+    bool     err = false;
+
+    if (ee_audiomark_run(0))
+    {
+        return true;
+    }
+
+    *dt = 0;
+    start_trigger();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        t0 = th_microseconds();
+        if (ee_audiomark_run(0))
+        {
+            err = true;
+            break;
+        }
+        iteration_dt[i] = th_microseconds() - t0;
+        *dt += iteration_dt[i];
+    }
+    stop_trigger();
+
+    for (uint32_t i = 0; i < iterations && !err; ++i)
+    {
+        printf("Iteration %-6lu : %llu cycles\n",
+               (unsigned long)i + 2,
+               (unsigned long long)iteration_dt[i]);
+    }
+    return err;
+}
+#endif
+
+#if AUDIOMARK_INSTANCES > 1
+#ifndef SPIKE
+#error "Multiple AudioMark instances need the Spike port, one per hart"
+#endif
+
+/**
+ * Throughput mode: AUDIOMARK_INSTANCES independent pipelines, instance i on
+ * hart i (spike -p<n>). Hart 0 comes through main(), the others through
+ * th_hart_main() once main() sets th_harts_go (see crt0.S).
+ *
+ * Initialization and release take turns in hart order, as they go through
+ * Speex's global heap pointers, malloc() and the console. The runs overlap,
+ * each hart timing its own with mcycle. They are always warm: every hart
+ * runs one unmeasured iteration, then all start the measured ones together.
+ * The aggregate score counts the audio of all instances over the time of
+ * the slowest hart. Afterwards hart 0 runs alone for the single-instance
+ * score that the scaling efficiency compares against.
+ */
+#define HART_ITERATIONS (AUDIOMARK_ITERATIONS > 1 ? AUDIOMARK_ITERATIONS - 1 : 1)
+
+volatile uint32_t th_harts_go;
+
+static uint32_t harts_turn; // init turns 0..n-1, then release turns n..2n-1
+static uint32_t harts_warm; // harts done with the warm-up
+static uint32_t harts_done; // harts done with the measured iterations
+static bool     harts_failed;
+static uint64_t harts_dt[AUDIOMARK_INSTANCES];
+
+static void
+harts_wait(uint32_t *p_count, uint32_t value)
+{
+    while (__atomic_load_n(p_count, __ATOMIC_ACQUIRE) < value)
+    {
+    }
+}
+
+static void
+harts_arrive(uint32_t *p_count)
+{
+    __atomic_fetch_add(p_count, 1, __ATOMIC_RELEASE);
+}
+
+static void
+hart_run(uint32_t hart)
+{
+    harts_wait(&harts_turn, hart);
+    if (ee_audiomark_initialize(hart))
+    {
+        printf("Failed to initialize instance %lu\n", (unsigned long)hart);
+        harts_failed = true;
+    }
+    harts_arrive(&harts_turn);
+    harts_wait(&harts_turn, AUDIOMARK_INSTANCES);
+
+    if (!harts_failed && ee_audiomark_run(hart))
+    {
+        harts_failed = true;
+    }
+    harts_arrive(&harts_warm);
+    harts_wait(&harts_warm, AUDIOMARK_INSTANCES);
+
+    if (!harts_failed)
+    {
+        if (hart == 0)
+        {
+            start_trigger();
+        }
+        if (time_audiomark_run(hart, HART_ITERATIONS, &harts_dt[hart]))
+        {
+            harts_failed = true;
+        }
+        if (hart == 0)
+        {
+            stop_trigger();
+        }
+    }
+    harts_arrive(&harts_done);
+}
+
+static void
+hart_release(uint32_t hart)
+{
+    harts_wait(&harts_turn, AUDIOMARK_INSTANCES + hart);
+    ee_audiomark_release(hart);
+    harts_arrive(&harts_turn);
+}
+
+void
+th_hart_main(uint32_t hart)
+{
+    hart_run(hart);
+    hart_release(hart);
+}
+
+int
+main(void)
+{
+    uint32_t iterations = HART_ITERATIONS;
+    uint64_t dt_max     = 0;
+    uint64_t dt_single  = 0;
+    bool     err        = false;
+
+    printf("Initializing %d instances\n", AUDIOMARK_INSTANCES);
+    __atomic_store_n(&th_harts_go, 1, __ATOMIC_RELEASE);
+    hart_run(0);
+    harts_wait(&harts_done, AUDIOMARK_INSTANCES);
+
+    err = harts_failed;
+    if (!err)
+    {
+        printf("Measuring a single instance\n");
+        err = time_audiomark_run(0, iterations, &dt_single);
+    }
+    if (err)
+    {
+        printf("Failed main performance run\n");
+        goto exit;
+    }
+
+    for (uint32_t i = 0; i < AUDIOMARK_INSTANCES; ++i)
+    {
+        printf("Hart %-11lu : %llu cycles\n",
+               (unsigned long)i,
+               (unsigned long long)harts_dt[i]);
+        dt_max = harts_dt[i] > dt_max ? harts_dt[i] : dt_max;
+    }
+
+    /* See main() below, but with the audio of all instances */
+    float sec    = (float)dt_max / 1.0e6f;
+    float clip   = (float)ee_audiomark_input_samples(0) / 16000.f;
+    float score  = (float)(iterations * AUDIOMARK_INSTANCES) / sec * 1000.f
+                  * (1 / clip);
+    float single = (float)iterations / ((float)dt_single / 1.0e6f) * 1000.f
+                   * (1 / clip);
+
+    printf("Total runtime    : %.3f seconds\n", sec);
+    printf("Total iterations : %d iterations\n", iterations * AUDIOMARK_INSTANCES);
+    printf("Score            : %f AudioMarks\n", score);
+    printf("Single instance  : %f AudioMarks\n", single);
+    printf("Scaling          : %.1f%% of %d x single instance\n",
+           100.f * score / (AUDIOMARK_INSTANCES * single),
+           AUDIOMARK_INSTANCES);
+exit:
+    hart_release(0);
+    harts_wait(&harts_turn, 2 * AUDIOMARK_INSTANCES);
+    exit(err);
+    return err ? -1 : 0;
+}
+#else
 int
 main(void)
 {
@@ -91,7 +293,7 @@ main(void)
 
     printf("Initializing\n");
 
-    if (ee_audiomark_initialize())
+    if (ee_audiomark_initialize(0))
     {
         printf("Failed to initialize\n");
         return -1;
@@ -103,7 +305,7 @@ main(void)
     do
     {
         iterations *= 2;
-        err = time_audiomark_run(iterations, &dt);
+        err = time_audiomark_run(0, iterations, &dt);
         if (err)
         {
             break;
@@ -127,7 +329,19 @@ main(void)
     #endif
     printf("Measuring\n");
 
-    err = time_audiomark_run(iterations, &dt);
+#if defined SPIKE && AUDIOMARK_ITERATIONS > 1
+    // One-time effects still skew a single iteration, see above
+    iterations = AUDIOMARK_ITERATIONS - 1;
+    err = time_audiomark_warm(iterations, &dt);
+#else
+#ifdef SPIKE
+    start_trigger();
+#endif
+    err = time_audiomark_run(0, iterations, &dt);
+#ifdef SPIKE
+    stop_trigger();
+#endif
+#endif
     if (err)
     {
         printf("Failed main performance run\n");
@@ -139,15 +353,19 @@ main(void)
      * match the throughput of the stream the score would be one iteration
      * per 1.5 seconds. The score is how many times faster than the ADC
      * the pipeline runs. x 1000 to make it a bigger number.
+     * With a shortened clip or a streamed input an iteration covers a
+     * different amount of audio.
      */
     float sec   = (float)dt / 1.0e6f;
-    float score = (float)iterations / sec * 1000.f * (1 / 1.5f);
+    float clip  = (float)ee_audiomark_input_samples(0) / 16000.f;
+    float score = (float)iterations / sec * 1000.f * (1 / clip);
 
     printf("Total runtime    : %.3f seconds\n", sec);
     printf("Total iterations : %d iterations\n", iterations);
     printf("Score            : %f AudioMarks\n", score);
 exit:
-    ee_audiomark_release();
+    ee_audiomark_release(0);
     exit(err);
     return err ? -1 : 0;
 }
+#endif
@@ -29,17 +29,17 @@ const int16_t left_microphone_capture[NINPUT_SAMPLES] = {
 const int16_t right_microphone_capture[NINPUT_SAMPLES] = {
 #include "ee_data/right0.txt"
 };
-int16_t for_asr[NINPUT_SAMPLES];
+int16_t for_asr[AUDIOMARK_INSTANCES][NINPUT_SAMPLES];
 
 // These are the inter-component buffers
-int16_t audio_input[SAMPLES_PER_AUDIO_FRAME];       // 1
-int16_t left_capture[SAMPLES_PER_AUDIO_FRAME];      // 2
-int16_t right_capture[SAMPLES_PER_AUDIO_FRAME];     // 3
-int16_t beamformer_output[SAMPLES_PER_AUDIO_FRAME]; // 4
-int16_t aec_output[SAMPLES_PER_AUDIO_FRAME];        // 5
-int16_t audio_fifo[AUDIO_FIFO_SAMPLES];             // 6
-int8_t  mfcc_fifo[MFCC_FIFO_BYTES];                 // 7
-int8_t  classes[OUT_DIM];                           // 8
+int16_t audio_input[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];       // 1
+int16_t left_capture[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];      // 2
+int16_t right_capture[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];     // 3
+int16_t beamformer_output[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME]; // 4
+int16_t aec_output[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];        // 5
+int16_t audio_fifo[AUDIOMARK_INSTANCES][AUDIO_FIFO_SAMPLES];             // 6
+int8_t  mfcc_fifo[AUDIOMARK_INSTANCES][MFCC_FIFO_BYTES];                 // 7
+int8_t  classes[AUDIOMARK_INSTANCES][OUT_DIM];                           // 8
 
 void *
 th_malloc(size_t size, int req)
@@ -167,6 +167,47 @@ th_cmplx_dot_prod_f32(const ee_f32_t *p_a,
     arm_cmplx_dot_prod_f32(p_a, p_b, len, p_r, p_i);
 }
 
+void
+th_cmplx_conj_dot_prod_f32(const ee_f32_t *p_a,
+                           const ee_f32_t *p_b,
+                           uint32_t        len,
+                           ee_f32_t       *p_r,
+                           ee_f32_t       *p_i)
+{
+    // CMSIS-DSP has no conjugate dot product, so conjugate a chunk at a time
+    ee_f32_t temp[2 * 16];
+    ee_f32_t r, i;
+
+    *p_r = 0.0f;
+    *p_i = 0.0f;
+    while (len > 0)
+    {
+        uint32_t n = len < 16 ? len : 16;
+
+        th_cmplx_conj_f32(p_a, temp, n);
+        th_cmplx_dot_prod_f32(temp, p_b, n, &r, &i);
+        *p_r += r;
+        *p_i += i;
+        p_a += 2 * n;
+        p_b += 2 * n;
+        len -= n;
+    }
+}
+
+void
+th_cmplx_nlms_update_f32(ee_f32_t       *p_w,
+                         const ee_f32_t *p_x,
+                         const ee_f32_t *p_e,
+                         ee_f32_t        mu,
+                         uint32_t        len)
+{
+    for (uint32_t j = 0; j < 2 * len; j += 2)
+    {
+        p_w[j] += mu * (p_e[0] * p_x[j] + p_e[1] * p_x[j + 1]);
+        p_w[j + 1] += mu * (p_e[0] * p_x[j + 1] - p_e[1] * p_x[j]);
+    }
+}
+
 void
 th_int16_to_f32(const int16_t *p_src, ee_f32_t *p_dst, uint32_t len)
 {
@@ -24,17 +24,17 @@ const int16_t left_microphone_capture[NINPUT_SAMPLES] = {
 const int16_t right_microphone_capture[NINPUT_SAMPLES] = {
 #include "ee_data/right0.txt"
 };
-int16_t for_asr[NINPUT_SAMPLES];
+int16_t for_asr[AUDIOMARK_INSTANCES][NINPUT_SAMPLES];
 
 // These are the inter-component buffers
-int16_t audio_input[SAMPLES_PER_AUDIO_FRAME];       // 1
-int16_t left_capture[SAMPLES_PER_AUDIO_FRAME];      // 2
-int16_t right_capture[SAMPLES_PER_AUDIO_FRAME];     // 3
-int16_t beamformer_output[SAMPLES_PER_AUDIO_FRAME]; // 4
-int16_t aec_output[SAMPLES_PER_AUDIO_FRAME];        // 5
-int16_t audio_fifo[AUDIO_FIFO_SAMPLES];             // 6
-int8_t  mfcc_fifo[MFCC_FIFO_BYTES];                 // 7
-int8_t  classes[OUT_DIM];                           // 8
+int16_t audio_input[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];       // 1
+int16_t left_capture[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];      // 2
+int16_t right_capture[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];     // 3
+int16_t beamformer_output[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME]; // 4
+int16_t aec_output[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];        // 5
+int16_t audio_fifo[AUDIOMARK_INSTANCES][AUDIO_FIFO_SAMPLES];             // 6
+int8_t  mfcc_fifo[AUDIOMARK_INSTANCES][MFCC_FIFO_BYTES];                 // 7
+int8_t  classes[AUDIOMARK_INSTANCES][OUT_DIM];                           // 8
 
 void *
 th_malloc(size_t size, int req)
@@ -150,6 +150,26 @@ th_cmplx_dot_prod_f32(const ee_f32_t *p_a,
     #warning "th_cmplx_dot_prod_f32() not implemented"
 }
 
+void
+th_cmplx_conj_dot_prod_f32(const ee_f32_t *p_a,
+                           const ee_f32_t *p_b,
+                           uint32_t        len,
+                           ee_f32_t       *p_r,
+                           ee_f32_t       *p_i)
+{
+    #warning "th_cmplx_conj_dot_prod_f32() not implemented"
+}
+
+void
+th_cmplx_nlms_update_f32(ee_f32_t       *p_w,
+                         const ee_f32_t *p_x,
+                         const ee_f32_t *p_e,
+                         ee_f32_t        mu,
+                         uint32_t        len)
+{
+    #warning "th_cmplx_nlms_update_f32() not implemented"
+}
+
 void
 th_int16_to_f32(const int16_t *p_src, ee_f32_t *p_dst, uint32_t len)
 {
@@ -0,0 +1,26 @@
+# RVV port: the scalar riscv port with the th_* DSP primitives replaced by
+# vector intrinsics, see th_dsp_rvv.c. Build with -march=..v, build.sh does
+# that for AUDIOMARK_PORT=riscv-v.
+set(RVV_PORT_DIR ${PORT_DIR})
+set(PORT_DIR ${RVV_PORT_DIR}/../riscv)
+include(${PORT_DIR}/port.cmake)
+set(PORT_DIR ${RVV_PORT_DIR})
+
+add_definitions(-DTH_API_RVV)
+list(APPEND PORT_SOURCE ${PORT_DIR}/th_dsp_rvv.c)
+
+# CMSIS-NN kernels of the KWS DS-CNN: the RVV ones in th_nn_rvv.c, or the
+# generic C ones of the scalar port
+set(TH_NN rvv CACHE STRING "KWS NN kernels (rvv or cmsis)")
+set_property(CACHE TH_NN PROPERTY STRINGS rvv cmsis)
+if(TH_NN STREQUAL "rvv")
+    set(TH_NN_CMSIS_DIR ${RVV_PORT_DIR}/../riscv/libs/CMSIS-NN/Source)
+    list(REMOVE_ITEM PORT_SOURCE
+        ${TH_NN_CMSIS_DIR}/ConvolutionFunctions/arm_convolve_s8.c
+        ${TH_NN_CMSIS_DIR}/ConvolutionFunctions/arm_convolve_1x1_s8_fast.c
+        ${TH_NN_CMSIS_DIR}/ConvolutionFunctions/arm_depthwise_conv_3x3_s8.c
+        ${TH_NN_CMSIS_DIR}/FullyConnectedFunctions/arm_fully_connected_s8.c)
+    list(APPEND PORT_SOURCE ${PORT_DIR}/th_nn_rvv.c)
+elseif(NOT TH_NN STREQUAL "cmsis")
+    message(FATAL_ERROR "Unknown TH_NN ${TH_NN}, use rvv or cmsis")
+endif()
@@ -0,0 +1,323 @@
+/* Copyright HighTec EDV-Systeme GmbH 2023
+
+   SPDX-License-Identifier: Apache-2.0 */
+
+/* RVV 1.0 versions of the th_* DSP primitives. The rest of the port (FFTs,
+   NN, memory) is the scalar riscv port, whose th_api.c leaves these out when
+   TH_API_RVV is defined. Everything is vector length agnostic, strip-mined
+   with vsetvl. Element-wise functions match CMSIS-DSP exactly; reductions sum
+   in a different order, like the unrolled CMSIS-DSP loops do. th_vlog_f32()
+   stays the scalar port's logf(), a vector polynomial wouldn't match it. */
+
+#include <riscv_vector.h>
+
+#include "ee_api.h"
+
+void
+th_absmax_f32(const ee_f32_t *p_in,
+              uint32_t        len,
+              ee_f32_t       *p_max,
+              uint32_t       *p_index)
+{
+    ee_f32_t best  = -1.0f;
+    uint32_t index = 0;
+    size_t   vl;
+
+    for (uint32_t i = 0; i < len; i += vl, p_in += vl)
+    {
+        vl                = __riscv_vsetvl_e32m8(len - i);
+        vfloat32m8_t v    = __riscv_vfabs_v_f32m8(__riscv_vle32_v_f32m8(p_in, vl), vl);
+        vfloat32m1_t vmax = __riscv_vfredmax_vs_f32m8_f32m1(
+            v, __riscv_vfmv_s_f_f32m1(-1.0f, 1), vl);
+        ee_f32_t m = __riscv_vfmv_f_s_f32m1_f32(vmax);
+        // Strictly greater, so the first maximum wins as in CMSIS-DSP
+        if (m > best)
+        {
+            vbool4_t eq = __riscv_vmfeq_vf_f32m8_b4(v, m, vl);
+            best        = m;
+            index       = i + __riscv_vfirst_m_b4(eq, vl);
+        }
+    }
+    *p_max   = best;
+    *p_index = index;
+}
+
+void
+th_cmplx_mult_cmplx_f32(const ee_f32_t *p_a,
+                        const ee_f32_t *p_b,
+                        ee_f32_t       *p_c,
+                        uint32_t        len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_a += 2 * vl, p_b += 2 * vl, p_c += 2 * vl)
+    {
+        vl                  = __riscv_vsetvl_e32m4(len);
+        vfloat32m4x2_t a    = __riscv_vlseg2e32_v_f32m4x2(p_a, vl);
+        vfloat32m4x2_t b    = __riscv_vlseg2e32_v_f32m4x2(p_b, vl);
+        vfloat32m4_t   a_re = __riscv_vget_v_f32m4x2_f32m4(a, 0);
+        vfloat32m4_t   a_im = __riscv_vget_v_f32m4x2_f32m4(a, 1);
+        vfloat32m4_t   b_re = __riscv_vget_v_f32m4x2_f32m4(b, 0);
+        vfloat32m4_t   b_im = __riscv_vget_v_f32m4x2_f32m4(b, 1);
+
+        vfloat32m4_t re = __riscv_vfmul_vv_f32m4(a_re, b_re, vl);
+        re              = __riscv_vfnmsac_vv_f32m4(re, a_im, b_im, vl);
+        vfloat32m4_t im = __riscv_vfmul_vv_f32m4(a_re, b_im, vl);
+        im              = __riscv_vfmacc_vv_f32m4(im, a_im, b_re, vl);
+        __riscv_vsseg2e32_v_f32m4x2(p_c, __riscv_vcreate_v_f32m4x2(re, im), vl);
+    }
+}
+
+void
+th_cmplx_conj_f32(const ee_f32_t *p_a, ee_f32_t *p_c, uint32_t len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_a += 2 * vl, p_c += 2 * vl)
+    {
+        vl               = __riscv_vsetvl_e32m4(len);
+        vfloat32m4x2_t a = __riscv_vlseg2e32_v_f32m4x2(p_a, vl);
+        vfloat32m4_t   re = __riscv_vget_v_f32m4x2_f32m4(a, 0);
+        vfloat32m4_t   im = __riscv_vfneg_v_f32m4(
+            __riscv_vget_v_f32m4x2_f32m4(a, 1), vl);
+        __riscv_vsseg2e32_v_f32m4x2(p_c, __riscv_vcreate_v_f32m4x2(re, im), vl);
+    }
+}
+
+void
+th_cmplx_dot_prod_f32(const ee_f32_t *p_a,
+                      const ee_f32_t *p_b,
+                      uint32_t        len,
+                      ee_f32_t       *p_r,
+                      ee_f32_t       *p_i)
+{
+    size_t       vlmax  = __riscv_vsetvlmax_e32m4();
+    vfloat32m4_t acc_re = __riscv_vfmv_v_f_f32m4(0.0f, vlmax);
+    vfloat32m4_t acc_im = __riscv_vfmv_v_f_f32m4(0.0f, vlmax);
+    size_t       vl;
+
+    for (; len > 0; len -= vl, p_a += 2 * vl, p_b += 2 * vl)
+    {
+        vl                  = __riscv_vsetvl_e32m4(len);
+        vfloat32m4x2_t a    = __riscv_vlseg2e32_v_f32m4x2(p_a, vl);
+        vfloat32m4x2_t b    = __riscv_vlseg2e32_v_f32m4x2(p_b, vl);
+        vfloat32m4_t   a_re = __riscv_vget_v_f32m4x2_f32m4(a, 0);
+        vfloat32m4_t   a_im = __riscv_vget_v_f32m4x2_f32m4(a, 1);
+        vfloat32m4_t   b_re = __riscv_vget_v_f32m4x2_f32m4(b, 0);
+        vfloat32m4_t   b_im = __riscv_vget_v_f32m4x2_f32m4(b, 1);
+
+        // Tail undisturbed, the last strip may be shorter
+        acc_re = __riscv_vfmacc_vv_f32m4_tu(acc_re, a_re, b_re, vl);
+        acc_re = __riscv_vfnmsac_vv_f32m4_tu(acc_re, a_im, b_im, vl);
+        acc_im = __riscv_vfmacc_vv_f32m4_tu(acc_im, a_re, b_im, vl);
+        acc_im = __riscv_vfmacc_vv_f32m4_tu(acc_im, a_im, b_re, vl);
+    }
+    vfloat32m1_t zero = __riscv_vfmv_s_f_f32m1(0.0f, 1);
+    *p_r              = __riscv_vfmv_f_s_f32m1_f32(
+        __riscv_vfredusum_vs_f32m4_f32m1(acc_re, zero, vlmax));
+    *p_i = __riscv_vfmv_f_s_f32m1_f32(
+        __riscv_vfredusum_vs_f32m4_f32m1(acc_im, zero, vlmax));
+}
+
+void
+th_cmplx_conj_dot_prod_f32(const ee_f32_t *p_a,
+                           const ee_f32_t *p_b,
+                           uint32_t        len,
+                           ee_f32_t       *p_r,
+                           ee_f32_t       *p_i)
+{
+    size_t       vlmax  = __riscv_vsetvlmax_e32m4();
+    vfloat32m4_t acc_re = __riscv_vfmv_v_f_f32m4(0.0f, vlmax);
+    vfloat32m4_t acc_im = __riscv_vfmv_v_f_f32m4(0.0f, vlmax);
+    size_t       vl;
+
+    for (; len > 0; len -= vl, p_a += 2 * vl, p_b += 2 * vl)
+    {
+        vl                  = __riscv_vsetvl_e32m4(len);
+        vfloat32m4x2_t a    = __riscv_vlseg2e32_v_f32m4x2(p_a, vl);
+        vfloat32m4x2_t b    = __riscv_vlseg2e32_v_f32m4x2(p_b, vl);
+        vfloat32m4_t   a_re = __riscv_vget_v_f32m4x2_f32m4(a, 0);
+        vfloat32m4_t   a_im = __riscv_vget_v_f32m4x2_f32m4(a, 1);
+        vfloat32m4_t   b_re = __riscv_vget_v_f32m4x2_f32m4(b, 0);
+        vfloat32m4_t   b_im = __riscv_vget_v_f32m4x2_f32m4(b, 1);
+
+        // As th_cmplx_dot_prod_f32 with the signs of a_im flipped
+        acc_re = __riscv_vfmacc_vv_f32m4_tu(acc_re, a_re, b_re, vl);
+        acc_re = __riscv_vfmacc_vv_f32m4_tu(acc_re, a_im, b_im, vl);
+        acc_im = __riscv_vfmacc_vv_f32m4_tu(acc_im, a_re, b_im, vl);
+        acc_im = __riscv_vfnmsac_vv_f32m4_tu(acc_im, a_im, b_re, vl);
+    }
+    vfloat32m1_t zero = __riscv_vfmv_s_f_f32m1(0.0f, 1);
+    *p_r              = __riscv_vfmv_f_s_f32m1_f32(
+        __riscv_vfredusum_vs_f32m4_f32m1(acc_re, zero, vlmax));
+    *p_i = __riscv_vfmv_f_s_f32m1_f32(
+        __riscv_vfredusum_vs_f32m4_f32m1(acc_im, zero, vlmax));
+}
+
+void
+th_cmplx_nlms_update_f32(ee_f32_t       *p_w,
+                         const ee_f32_t *p_x,
+                         const ee_f32_t *p_e,
+                         ee_f32_t        mu,
+                         uint32_t        len)
+{
+    ee_f32_t mu_e_re = mu * p_e[0];
+    ee_f32_t mu_e_im = mu * p_e[1];
+    size_t   vl;
+
+    for (; len > 0; len -= vl, p_w += 2 * vl, p_x += 2 * vl)
+    {
+        vl                  = __riscv_vsetvl_e32m4(len);
+        vfloat32m4x2_t w    = __riscv_vlseg2e32_v_f32m4x2(p_w, vl);
+        vfloat32m4x2_t x    = __riscv_vlseg2e32_v_f32m4x2(p_x, vl);
+        vfloat32m4_t   w_re = __riscv_vget_v_f32m4x2_f32m4(w, 0);
+        vfloat32m4_t   w_im = __riscv_vget_v_f32m4x2_f32m4(w, 1);
+        vfloat32m4_t   x_re = __riscv_vget_v_f32m4x2_f32m4(x, 0);
+        vfloat32m4_t   x_im = __riscv_vget_v_f32m4x2_f32m4(x, 1);
+
+        w_re = __riscv_vfmacc_vf_f32m4(w_re, mu_e_re, x_re, vl);
+        w_re = __riscv_vfmacc_vf_f32m4(w_re, mu_e_im, x_im, vl);
+        w_im = __riscv_vfmacc_vf_f32m4(w_im, mu_e_re, x_im, vl);
+        w_im = __riscv_vfnmsac_vf_f32m4(w_im, mu_e_im, x_re, vl);
+        __riscv_vsseg2e32_v_f32m4x2(p_w, __riscv_vcreate_v_f32m4x2(w_re, w_im), vl);
+    }
+}
+
+void
+th_int16_to_f32(const int16_t *p_src, ee_f32_t *p_dst, uint32_t len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_src += vl, p_dst += vl)
+    {
+        vl             = __riscv_vsetvl_e16m4(len);
+        vfloat32m8_t f = __riscv_vfwcvt_f_x_v_f32m8(
+            __riscv_vle16_v_i16m4(p_src, vl), vl);
+        // Exact, same as dividing by 32768 in arm_q15_to_float()
+        __riscv_vse32_v_f32m8(p_dst, __riscv_vfmul_vf_f32m8(f, 1.0f / 32768.0f, vl), vl);
+    }
+}
+
+void
+th_f32_to_int16(const ee_f32_t *p_src, int16_t *p_dst, uint32_t len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_src += vl, p_dst += vl)
+    {
+        vl             = __riscv_vsetvl_e32m8(len);
+        vfloat32m8_t f = __riscv_vfmul_vf_f32m8(
+            __riscv_vle32_v_f32m8(p_src, vl), 32768.0f, vl);
+        // Truncate like the (q31_t) cast, then saturate like __SSAT(x, 16)
+        vint32m8_t q = __riscv_vfcvt_rtz_x_f_v_i32m8(f, vl);
+        __riscv_vse16_v_i16m4(
+            p_dst, __riscv_vnclip_wx_i16m4(q, 0, __RISCV_VXRM_RNU, vl), vl);
+    }
+}
+
+void
+th_add_f32(ee_f32_t *p_a, ee_f32_t *p_b, ee_f32_t *p_c, uint32_t len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_a += vl, p_b += vl, p_c += vl)
+    {
+        vl             = __riscv_vsetvl_e32m8(len);
+        vfloat32m8_t a = __riscv_vle32_v_f32m8(p_a, vl);
+        vfloat32m8_t b = __riscv_vle32_v_f32m8(p_b, vl);
+        __riscv_vse32_v_f32m8(p_c, __riscv_vfadd_vv_f32m8(a, b, vl), vl);
+    }
+}
+
+void
+th_subtract_f32(ee_f32_t *p_a, ee_f32_t *p_b, ee_f32_t *p_c, uint32_t len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_a += vl, p_b += vl, p_c += vl)
+    {
+        vl             = __riscv_vsetvl_e32m8(len);
+        vfloat32m8_t a = __riscv_vle32_v_f32m8(p_a, vl);
+        vfloat32m8_t b = __riscv_vle32_v_f32m8(p_b, vl);
+        __riscv_vse32_v_f32m8(p_c, __riscv_vfsub_vv_f32m8(a, b, vl), vl);
+    }
+}
+
+static ee_f32_t
+dot_prod(const ee_f32_t *p_a, const ee_f32_t *p_b, uint32_t len)
+{
+    size_t       vlmax = __riscv_vsetvlmax_e32m8();
+    vfloat32m8_t acc   = __riscv_vfmv_v_f_f32m8(0.0f, vlmax);
+    size_t       vl;
+
+    for (; len > 0; len -= vl, p_a += vl, p_b += vl)
+    {
+        vl             = __riscv_vsetvl_e32m8(len);
+        vfloat32m8_t a = __riscv_vle32_v_f32m8(p_a, vl);
+        vfloat32m8_t b = __riscv_vle32_v_f32m8(p_b, vl);
+        acc            = __riscv_vfmacc_vv_f32m8_tu(acc, a, b, vl);
+    }
+    return __riscv_vfmv_f_s_f32m1_f32(__riscv_vfredusum_vs_f32m8_f32m1(
+        acc, __riscv_vfmv_s_f_f32m1(0.0f, 1), vlmax));
+}
+
+void
+th_dot_prod_f32(ee_f32_t *p_a, ee_f32_t *p_b, uint32_t len, ee_f32_t *p_result)
+{
+    *p_result = dot_prod(p_a, p_b, len);
+}
+
+void
+th_multiply_f32(ee_f32_t *p_a, ee_f32_t *p_b, ee_f32_t *p_c, uint32_t len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_a += vl, p_b += vl, p_c += vl)
+    {
+        vl             = __riscv_vsetvl_e32m8(len);
+        vfloat32m8_t a = __riscv_vle32_v_f32m8(p_a, vl);
+        vfloat32m8_t b = __riscv_vle32_v_f32m8(p_b, vl);
+        __riscv_vse32_v_f32m8(p_c, __riscv_vfmul_vv_f32m8(a, b, vl), vl);
+    }
+}
+
+void
+th_cmplx_mag_f32(ee_f32_t *p_a, ee_f32_t *p_c, uint32_t len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_a += 2 * vl, p_c += vl)
+    {
+        vl                = __riscv_vsetvl_e32m4(len);
+        vfloat32m4x2_t a  = __riscv_vlseg2e32_v_f32m4x2(p_a, vl);
+        vfloat32m4_t   re = __riscv_vget_v_f32m4x2_f32m4(a, 0);
+        vfloat32m4_t   im = __riscv_vget_v_f32m4x2_f32m4(a, 1);
+        vfloat32m4_t   sq = __riscv_vfmul_vv_f32m4(re, re, vl);
+        sq                = __riscv_vfmacc_vv_f32m4(sq, im, im, vl);
+        __riscv_vse32_v_f32m4(p_c, __riscv_vfsqrt_v_f32m4(sq, vl), vl);
+    }
+}
+
+void
+th_offset_f32(ee_f32_t *p_a, ee_f32_t offset, ee_f32_t *p_c, uint32_t len)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_a += vl, p_c += vl)
+    {
+        vl             = __riscv_vsetvl_e32m8(len);
+        vfloat32m8_t a = __riscv_vle32_v_f32m8(p_a, vl);
+        __riscv_vse32_v_f32m8(p_c, __riscv_vfadd_vf_f32m8(a, offset, vl), vl);
+    }
+}
+
+void
+th_mat_vec_mult_f32(ee_matrix_f32_t *p_a, ee_f32_t *p_b, ee_f32_t *p_c)
+{
+    const ee_f32_t *row = p_a->pData;
+
+    for (uint32_t i = 0; i < p_a->numRows; i++, row += p_a->numCols)
+    {
+        p_c[i] = dot_prod(row, p_b, p_a->numCols);
+    }
+}
@@ -0,0 +1,423 @@
+/* Copyright HighTec EDV-Systeme GmbH 2023
+
+   SPDX-License-Identifier: Apache-2.0 */
+
+/* RVV 1.0 versions of the CMSIS-NN kernels the KWS DS-CNN runs through the
+   wrappers: the first convolution (arm_convolve_s8), the pointwise ones
+   (arm_convolve_1x1_s8_fast), the 3x3 depthwise ones and the classifier
+   (arm_fully_connected_s8). port.cmake builds this file instead of the
+   generic C ones when TH_NN=rvv.
+
+   The multiply-accumulates are exact in int32 whatever the order, and the
+   requantization is the scalar arm_nn_requantize(), so the outputs are bit
+   identical to CMSIS-NN. Products of two int8 fit in int16, sums of them do
+   not, so they get widened to int32 accumulators right away. */
+
+#include <string.h>
+#include <riscv_vector.h>
+
+#include "arm_nnfunctions.h"
+#include "arm_nnsupportfunctions.h"
+
+/* Channels per depthwise strip, bounds the accumulator spill on the stack */
+#define TH_NN_DW_STRIP 64
+
+/* Sum of a * b */
+static int32_t
+th_nn_dot_s8(const int8_t *p_a, const int8_t *p_b, int32_t len)
+{
+    size_t     vlmax = __riscv_vsetvlmax_e32m4();
+    vint32m4_t acc   = __riscv_vmv_v_x_i32m4(0, vlmax);
+    size_t     vl;
+
+    for (; len > 0; len -= vl, p_a += vl, p_b += vl)
+    {
+        vl              = __riscv_vsetvl_e8m1(len);
+        vint8m1_t  a    = __riscv_vle8_v_i8m1(p_a, vl);
+        vint8m1_t  b    = __riscv_vle8_v_i8m1(p_b, vl);
+        vint16m2_t prod = __riscv_vwmul_vv_i16m2(a, b, vl);
+        // Tail undisturbed, the last strip may be shorter
+        acc = __riscv_vwadd_wv_i32m4_tu(acc, acc, prod, vl);
+    }
+    return __riscv_vmv_x_s_i32m1_i32(__riscv_vredsum_vs_i32m4_i32m1(
+        acc, __riscv_vmv_s_x_i32m1(0, 1), vlmax));
+}
+
+/* Sum of w * x, x already widened */
+static int32_t
+th_nn_dot_s8_s16(const int8_t *p_w, const int16_t *p_x, int32_t len)
+{
+    size_t     vlmax = __riscv_vsetvlmax_e32m4();
+    vint32m4_t acc   = __riscv_vmv_v_x_i32m4(0, vlmax);
+    size_t     vl;
+
+    for (; len > 0; len -= vl, p_w += vl, p_x += vl)
+    {
+        vl           = __riscv_vsetvl_e16m2(len);
+        vint16m2_t w = __riscv_vsext_vf2_i16m2(__riscv_vle8_v_i8m1(p_w, vl), vl);
+        vint16m2_t x = __riscv_vle16_v_i16m2(p_x, vl);
+        acc          = __riscv_vwmacc_vv_i32m4_tu(acc, w, x, vl);
+    }
+    return __riscv_vmv_x_s_i32m1_i32(__riscv_vredsum_vs_i32m4_i32m1(
+        acc, __riscv_vmv_s_x_i32m1(0, 1), vlmax));
+}
+
+/* Sum of a */
+static int32_t
+th_nn_sum_s8(const int8_t *p_a, int32_t len)
+{
+    size_t     vlmax = __riscv_vsetvlmax_e32m4();
+    vint32m4_t acc   = __riscv_vmv_v_x_i32m4(0, vlmax);
+    size_t     vl;
+
+    for (; len > 0; len -= vl, p_a += vl)
+    {
+        vl  = __riscv_vsetvl_e8m1(len);
+        acc = __riscv_vadd_vv_i32m4_tu(
+            acc, acc, __riscv_vsext_vf4_i32m4(__riscv_vle8_v_i8m1(p_a, vl), vl), vl);
+    }
+    return __riscv_vmv_x_s_i32m1_i32(__riscv_vredsum_vs_i32m4_i32m1(
+        acc, __riscv_vmv_s_x_i32m1(0, 1), vlmax));
+}
+
+/* dst = src + offset, like arm_q7_to_q15_with_offset() */
+static void
+th_nn_widen_s8(const int8_t *p_src, int16_t *p_dst, int32_t len, int32_t offset)
+{
+    size_t vl;
+
+    for (; len > 0; len -= vl, p_src += vl, p_dst += vl)
+    {
+        vl           = __riscv_vsetvl_e16m2(len);
+        vint16m2_t x = __riscv_vsext_vf2_i16m2(__riscv_vle8_v_i8m1(p_src, vl), vl);
+        __riscv_vse16_v_i16m2(p_dst, __riscv_vadd_vx_i16m2(x, offset, vl), vl);
+    }
+}
+
+static inline int8_t
+th_nn_requantize_s8(int32_t acc,
+                    int32_t multiplier,
+                    int32_t shift,
+                    int32_t out_offset,
+                    int32_t act_min,
+                    int32_t act_max)
+{
+    acc = arm_nn_requantize(acc, multiplier, shift) + out_offset;
+    return (int8_t)MIN(MAX(acc, act_min), act_max);
+}
+
+/* im2col one output pixel at a time, then one dot product per channel */
+arm_cmsis_nn_status
+arm_convolve_s8(const cmsis_nn_context                *ctx,
+                const cmsis_nn_conv_params            *conv_params,
+                const cmsis_nn_per_channel_quant_params *quant_params,
+                const cmsis_nn_dims                   *input_dims,
+                const int8_t                          *input_data,
+                const cmsis_nn_dims                   *filter_dims,
+                const int8_t                          *filter_data,
+                const cmsis_nn_dims                   *bias_dims,
+                const int32_t                         *bias_data,
+                const cmsis_nn_dims                   *output_dims,
+                int8_t                                *output_data)
+{
+    (void)bias_dims;
+    if (ctx->buf == NULL)
+    {
+        return ARM_CMSIS_NN_ARG_ERROR;
+    }
+    int16_t *p_col = (int16_t *)ctx->buf;
+
+    const int32_t input_x    = input_dims->w;
+    const int32_t input_y    = input_dims->h;
+    const int32_t input_ch   = input_dims->c;
+    const int32_t kernel_x   = filter_dims->w;
+    const int32_t kernel_y   = filter_dims->h;
+    const int32_t output_x   = output_dims->w;
+    const int32_t output_y   = output_dims->h;
+    const int32_t output_ch  = output_dims->c;
+    const int32_t pad_x      = conv_params->padding.w;
+    const int32_t pad_y      = conv_params->padding.h;
+    const int32_t stride_x   = conv_params->stride.w;
+    const int32_t stride_y   = conv_params->stride.h;
+    const int32_t dilation_x = conv_params->dilation.w;
+    const int32_t dilation_y = conv_params->dilation.h;
+    const int32_t col_len    = input_ch * kernel_y * kernel_x;
+
+    for (int32_t i_batch = 0; i_batch < input_dims->n; i_batch++)
+    {
+        for (int32_t i_out_y = 0; i_out_y < output_y; i_out_y++)
+        {
+            for (int32_t i_out_x = 0; i_out_x < output_x; i_out_x++)
+            {
+                const int32_t base_y = stride_y * i_out_y - pad_y;
+                const int32_t base_x = stride_x * i_out_x - pad_x;
+                int16_t      *p_dst  = p_col;
+
+                // Padding reads as zero after the input offset
+                for (int32_t i_ker_y = 0; i_ker_y < kernel_y; i_ker_y++)
+                {
+                    const int32_t k_y = base_y + dilation_y * i_ker_y;
+                    if (k_y < 0 || k_y >= input_y)
+                    {
+                        memset(p_dst, 0, kernel_x * input_ch * sizeof(int16_t));
+                        p_dst += kernel_x * input_ch;
+                        continue;
+                    }
+                    const int8_t *p_row = input_data + k_y * input_x * input_ch;
+                    if (dilation_x == 1)
+                    {
+                        // The taps in range are one run of the input row
+                        int32_t first = MAX(0, -base_x);
+                        int32_t last  = MIN(kernel_x, input_x - base_x);
+                        last          = MAX(first, last);
+                        memset(p_dst, 0, first * input_ch * sizeof(int16_t));
+                        th_nn_widen_s8(p_row + (base_x + first) * input_ch,
+                                       p_dst + first * input_ch,
+                                       (last - first) * input_ch,
+                                       conv_params->input_offset);
+                        memset(p_dst + last * input_ch,
+                               0,
+                               (kernel_x - last) * input_ch * sizeof(int16_t));
+                        p_dst += kernel_x * input_ch;
+                        continue;
+                    }
+                    for (int32_t i_ker_x = 0; i_ker_x < kernel_x; i_ker_x++)
+                    {
+                        const int32_t k_x = base_x + dilation_x * i_ker_x;
+                        if (k_x < 0 || k_x >= input_x)
+                        {
+                            memset(p_dst, 0, input_ch * sizeof(int16_t));
+                        }
+                        else
+                        {
+                            th_nn_widen_s8(p_row + k_x * input_ch,
+                                           p_dst,
+                                           input_ch,
+                                           conv_params->input_offset);
+                        }
+                        p_dst += input_ch;
+                    }
+                }
+
+                const int8_t *p_ker = filter_data;
+                for (int32_t i = 0; i < output_ch; i++, p_ker += col_len)
+                {
+                    int32_t acc = bias_data ? bias_data[i] : 0;
+                    acc += th_nn_dot_s8_s16(p_ker, p_col, col_len);
+                    *output_data++ = th_nn_requantize_s8(
+                        acc,
+                        quant_params->multiplier[i],
+                        quant_params->shift[i],
+                        conv_params->output_offset,
+                        conv_params->activation.min,
+                        conv_params->activation.max);
+                }
+            }
+        }
+        input_data += input_x * input_y * input_ch;
+    }
+    return ARM_CMSIS_NN_SUCCESS;
+}
+
+int32_t
+arm_convolve_s8_get_buffer_size(const cmsis_nn_dims *input_dims,
+                                const cmsis_nn_dims *filter_dims)
+{
+    // One im2col column
+    return input_dims->c * filter_dims->w * filter_dims->h
+           * (int32_t)sizeof(int16_t);
+}
+
+/* A matrix product, output channel by output channel so that the input
+   offset term, input_offset * sum(weights), is computed once per channel */
+arm_cmsis_nn_status
+arm_convolve_1x1_s8_fast(const cmsis_nn_context                 *ctx,
+                         const cmsis_nn_conv_params             *conv_params,
+                         const cmsis_nn_per_channel_quant_params *quant_params,
+                         const cmsis_nn_dims                    *input_dims,
+                         const int8_t                           *input_data,
+                         const cmsis_nn_dims                    *filter_dims,
+                         const int8_t                           *filter_data,
+                         const cmsis_nn_dims                    *bias_dims,
+                         const int32_t                          *bias_data,
+                         const cmsis_nn_dims                    *output_dims,
+                         int8_t                                 *output_data)
+{
+    (void)ctx;
+    (void)filter_dims;
+    (void)bias_dims;
+    if (conv_params->padding.w != 0 || conv_params->padding.h != 0
+        || conv_params->stride.w != 1 || conv_params->stride.h != 1)
+    {
+        return ARM_CMSIS_NN_ARG_ERROR;
+    }
+
+    const int32_t pixels    = input_dims->w * input_dims->h * input_dims->n;
+    const int32_t input_ch  = input_dims->c;
+    const int32_t output_ch = output_dims->c;
+
+    for (int32_t i = 0; i < output_ch; i++)
+    {
+        const int8_t *p_ker = filter_data + i * input_ch;
+        int32_t       base  = bias_data ? bias_data[i] : 0;
+        base += conv_params->input_offset * th_nn_sum_s8(p_ker, input_ch);
+
+        for (int32_t p = 0; p < pixels; p++)
+        {
+            int32_t acc = base + th_nn_dot_s8(input_data + p * input_ch, p_ker, input_ch);
+            output_data[p * output_ch + i] = th_nn_requantize_s8(
+                acc,
+                quant_params->multiplier[i],
+                quant_params->shift[i],
+                conv_params->output_offset,
+                conv_params->activation.min,
+                conv_params->activation.max);
+        }
+    }
+    return ARM_CMSIS_NN_SUCCESS;
+}
+
+int32_t
+arm_convolve_1x1_s8_fast_get_buffer_size(const cmsis_nn_dims *input_dims)
+{
+    (void)input_dims;
+    return 0;
+}
+
+/* Vectorized across channels, which are contiguous in HWC */
+arm_cmsis_nn_status
+arm_depthwise_conv_3x3_s8(const cmsis_nn_context                 *ctx,
+                          const cmsis_nn_dw_conv_params          *dw_conv_params,
+                          const cmsis_nn_per_channel_quant_params *quant_params,
+                          const cmsis_nn_dims                    *input_dims,
+                          const int8_t                           *input,
+                          const cmsis_nn_dims                    *filter_dims,
+                          const int8_t                           *kernel,
+                          const cmsis_nn_dims                    *bias_dims,
+                          const int32_t                          *bias,
+                          const cmsis_nn_dims                    *output_dims,
+                          int8_t                                 *output)
+{
+    (void)ctx;
+    (void)bias_dims;
+
+    const int32_t input_x  = input_dims->w;
+    const int32_t input_y  = input_dims->h;
+    const int32_t input_ch = input_dims->c;
+    const int32_t pad_x    = dw_conv_params->padding.w;
+    const int32_t pad_y    = dw_conv_params->padding.h;
+    const int32_t stride_x = dw_conv_params->stride.w;
+    const int32_t stride_y = dw_conv_params->stride.h;
+    const int32_t offset   = dw_conv_params->input_offset;
+
+    // Same constraints as the generic version
+    if (input_ch != output_dims->c)
+    {
+        return ARM_CMSIS_NN_ARG_ERROR;
+    }
+    if (pad_x > 1 || filter_dims->w != 3 || filter_dims->h != 3)
+    {
+        return ARM_CMSIS_NN_ARG_ERROR;
+    }
+
+    int32_t acc_buf[TH_NN_DW_STRIP];
+
+    for (int32_t out_h = 0; out_h < output_dims->h; out_h++)
+    {
+        const int32_t in_h   = out_h * stride_y - pad_y;
+        const int32_t ker_y0 = MAX(0, -in_h);
+        const int32_t ker_y1 = MIN(3, input_y - in_h);
+
+        for (int32_t out_w = 0; out_w < output_dims->w; out_w++)
+        {
+            const int32_t in_w   = out_w * stride_x - pad_x;
+            const int32_t ker_x0 = MAX(0, -in_w);
+            const int32_t ker_x1 = MIN(3, input_x - in_w);
+            size_t        vl;
+
+            for (int32_t c = 0; c < input_ch; c += vl)
+            {
+                vl             = __riscv_vsetvl_e16m2(MIN(input_ch - c, TH_NN_DW_STRIP));
+                vint32m4_t acc = bias ? __riscv_vle32_v_i32m4(bias + c, vl)
+                                      : __riscv_vmv_v_x_i32m4(0, vl);
+
+                for (int32_t ky = ker_y0; ky < ker_y1; ky++)
+                {
+                    const int8_t *p_in
+                        = input + ((in_h + ky) * input_x + in_w) * input_ch + c;
+                    const int8_t *p_ker = kernel + ky * 3 * input_ch + c;
+                    for (int32_t kx = ker_x0; kx < ker_x1; kx++)
+                    {
+                        vint16m2_t x = __riscv_vsext_vf2_i16m2(
+                            __riscv_vle8_v_i8m1(p_in + kx * input_ch, vl), vl);
+                        vint16m2_t w = __riscv_vsext_vf2_i16m2(
+                            __riscv_vle8_v_i8m1(p_ker + kx * input_ch, vl), vl);
+                        x   = __riscv_vadd_vx_i16m2(x, offset, vl);
+                        acc = __riscv_vwmacc_vv_i32m4(acc, w, x, vl);
+                    }
+                }
+                __riscv_vse32_v_i32m4(acc_buf, acc, vl);
+                for (size_t i = 0; i < vl; i++)
+                {
+                    *output++ = th_nn_requantize_s8(
+                        acc_buf[i],
+                        quant_params->multiplier[c + i],
+                        quant_params->shift[c + i],
+                        dw_conv_params->output_offset,
+                        dw_conv_params->activation.min,
+                        dw_conv_params->activation.max);
+                }
+            }
+        }
+    }
+    return ARM_CMSIS_NN_SUCCESS;
+}
+
+/* Same dot products as the pointwise convolution, per-tensor quantization */
+arm_cmsis_nn_status
+arm_fully_connected_s8(const cmsis_nn_context            *ctx,
+                       const cmsis_nn_fc_params          *fc_params,
+                       const cmsis_nn_per_tensor_quant_params *quant_params,
+                       const cmsis_nn_dims               *input_dims,
+                       const int8_t                      *input,
+                       const cmsis_nn_dims               *filter_dims,
+                       const int8_t                      *kernel,
+                       const cmsis_nn_dims               *bias_dims,
+                       const int32_t                     *bias,
+                       const cmsis_nn_dims               *output_dims,
+                       int8_t                            *output)
+{
+    (void)ctx;
+    (void)bias_dims;
+    (void)fc_params->filter_offset;
+
+    const int32_t accum_depth  = filter_dims->n;
+    const int32_t output_depth = output_dims->c;
+
+    for (int32_t i = 0; i < output_depth; i++)
+    {
+        const int8_t *p_ker = kernel + i * accum_depth;
+        int32_t       base  = bias ? bias[i] : 0;
+        base += fc_params->input_offset * th_nn_sum_s8(p_ker, accum_depth);
+
+        for (int32_t b = 0; b < input_dims->n; b++)
+        {
+            int32_t acc = base + th_nn_dot_s8(input + b * accum_depth, p_ker, accum_depth);
+            output[b * output_depth + i] = th_nn_requantize_s8(
+                acc,
+                quant_params->multiplier,
+                quant_params->shift,
+                fc_params->output_offset,
+                fc_params->activation.min,
+                fc_params->activation.max);
+        }
+    }
+    return ARM_CMSIS_NN_SUCCESS;
+}
+
+int32_t
+arm_fully_connected_s8_get_buffer_size(const cmsis_nn_dims *filter_dims)
+{
+    (void)filter_dims;
+    return 0;
+}
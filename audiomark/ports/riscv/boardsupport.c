@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include "../../../common/perf_counters.h"
 
 unsigned long long start;
 extern void _exit(int i);
@@ -22,6 +24,60 @@ uint64_t get_system_us ()
     unsigned long lo = read_csr(mcycle);
     return (unsigned long long)(((CORETIMETYPE)hi) << 32) | lo;
 }
+#if AUDIOMARK_INSTANCES > 1
+/* crt0.S sends the other harts here. The unit tests link the port without
+   main.c, and their extra harts just keep waiting. */
+__attribute__((weak)) volatile uint32_t th_harts_go;
+__attribute__((weak)) void th_hart_main(uint32_t hart)
+{
+}
+#endif
+
+/* Counts per pipeline stage, indexed by the component numbers of
+   ee_audiomark.h. Stage 0 is everything outside the components, mostly
+   frame routing. */
+#define STAGES 5
+static const char *stage_names[STAGES] = { "other", "bmf", "aec", "anr", "kws" };
+static struct perf_counters stage_last;
+static struct perf_counters stage_sum[STAGES];
+
+void start_trigger()
+{
+    perf_start();
+    stage_last = perf_start_sample;
+    memset(stage_sum, 0, sizeof(stage_sum));
+}
+/* Charge the counts since the previous call to "stage". With several
+   AudioMark instances, only hart 0's is broken down. */
+void stage_trigger(int stage)
+{
+    struct perf_counters now;
+#if AUDIOMARK_INSTANCES > 1
+    if (read_csr(mhartid) != 0)
+        return;
+#endif
+    perf_read(&now);
+    perf_add(&stage_sum[stage], &stage_last, &now);
+    stage_last = now;
+}
+void stop_trigger()
+{
+    static const struct perf_counters zero;
+    char name[32];
+    uint64_t total = 0;
+
+    perf_stop("audiomark");
+    for (int i = 0; i < STAGES; i++) {
+        snprintf(name, sizeof(name), "audiomark.%s", stage_names[i]);
+        perf_report(name, &zero, &stage_sum[i]);
+        total += stage_sum[i].cycles;
+    }
+    for (int i = 0; i < STAGES; i++) {
+        printf("Stage %-5s : %12llu cycles, %5.1f%%\n", stage_names[i],
+               (unsigned long long)stage_sum[i].cycles,
+               total ? 100.0 * stage_sum[i].cycles / total : 0.0);
+    }
+}
 void terminate()
 {
     _exit(0);
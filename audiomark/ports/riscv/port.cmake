@@ -8,8 +8,19 @@ include_directories(${PORT_DIR}/libs/CMSIS-NN/Include)
 link_directories(${PORT_DIR})
 set(LINKER_SCRIPT link.ld)
 
-# Switch SpeeX to SmallFFT mode, whatever that means
-add_definitions(-DUSE_SMALLFT)
+# FFT behind SpeeX's fftwrap.c: the Vorbis smallft, kiss_fft or the
+# CMSIS-DSP rfft_fast that th_api.c already links for the MFCC
+set(SPEEX_FFT smallft CACHE STRING "SpeeX FFT (smallft, kiss or cmsis)")
+set_property(CACHE SPEEX_FFT PROPERTY STRINGS smallft kiss cmsis)
+if(SPEEX_FFT STREQUAL "smallft")
+    add_definitions(-DUSE_SMALLFT)
+elseif(SPEEX_FFT STREQUAL "kiss")
+    add_definitions(-DUSE_KISS_FFT)
+elseif(SPEEX_FFT STREQUAL "cmsis")
+    add_definitions(-DUSE_CMSIS_DSP)
+else()
+    message(FATAL_ERROR "Unknown SPEEX_FFT ${SPEEX_FFT}, use smallft, kiss or cmsis")
+endif()
 # Lie to get the right timing interface
 add_definitions(-D__PERF_COUNTER__)
 add_definitions(-DSPIKE)
@@ -17,6 +28,7 @@ add_definitions(-DSPIKE)
 
 set(PORT_SOURCE
     ${PORT_DIR}/th_api.c
+    ${PORT_DIR}/th_stream.c
 
     ${PORT_DIR}/stub.c
     ${PORT_DIR}/util.c
@@ -8,6 +8,7 @@
 
 #include "ns16550.h"
 #include "util.h"
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <errno.h>
 
@@ -50,78 +51,121 @@ __attribute__((__used__)) int _getpid(void)
 
 
 /**
-* This library does not support any file I/O of any kind.
+* File descriptors above stderr are files on the host, opened through
+* Spike's syscall proxy (see htif_open()). The proxy returns -errno on
+* failure.
+*****************************************************************/
+#define HOST_FD(file)	((file) > 2)
+
+static int host_ret(long ret)
+{
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+/**
+* Closes a host file. The standard streams can't be closed.
 *
-* @return -1 Indicating that file could not be closed.
+* @return 0 on success, -1 on error.
 *****************************************************************/
 __attribute__((__used__)) int _close(int file)
 {
+	if (HOST_FD(file))
+		return host_ret(htif_close(file));
 	errno = EBADF;
 	return -1;
 }
 
 /**
-* This library does not support any file I/O of any kind.
-* This call will return a status indicating that the file
-* in question is a character device.
+* Host files are reported as regular files, so that stdio buffers
+* them. Anything else is reported as a character device.
 *
 * @return 0 Indicating that the call has succeeded.
 *****************************************************************/
 __attribute__((__used__)) int _fstat(int file, struct stat *st)
 {
+	if (HOST_FD(file)) {
+		memset(st, 0, sizeof(*st));
+		st->st_mode = S_IFREG;
+		return 0;
+	}
 	st->st_mode = S_IFCHR;
 	return 0;
 }
 /**
-* This library does not support any file I/O of any kind.
+* Only the standard streams are terminals.
 *
 * @return 1 Indicating that file is a tty device (a terminal.)
 *****************************************************************/
 __attribute__((__used__)) int _isatty(int file)
 {
-	return 1;
+	return !HOST_FD(file);
 }
 
 /**
-* This library does not support any file I/O of any kind.
+* Seeks in a host file. Seeking the standard streams is ignored.
 *
-* @return 0 Indicating that the request has succeeded.
+* @return The new offset, or -1 on error.
 *****************************************************************/
 __attribute__((__used__)) int _lseek(int file, int ptr, int dir)
 {
+	if (HOST_FD(file))
+		return host_ret(htif_lseek(file, ptr, dir));
 	return 0;
 }
 
 /**
-* This library does not support any file I/O of any kind.
+* Opens a file on the host, relative to Spike's working directory.
+* newlib's open() flags differ from the Linux ones the proxy passes
+* on, so they are translated.
 *
-* @return -1 (error codition.)
+* @return The file descriptor, or -1 on error.
 *****************************************************************/
 __attribute__((__used__)) int _open(const char *name, int flags, int mode)
 {
-	errno = ENFILE;		// The system-wide limit (0) on total open files has been reached.
-	return -1;
+	int hflags;
+
+	switch (flags & O_ACCMODE) {
+	case O_WRONLY:	hflags = HTIF_O_WRONLY; break;
+	case O_RDWR:	hflags = HTIF_O_RDWR; break;
+	default:	hflags = HTIF_O_RDONLY; break;
+	}
+	if (flags & O_CREAT)
+		hflags |= HTIF_O_CREAT;
+	if (flags & O_EXCL)
+		hflags |= HTIF_O_EXCL;
+	if (flags & O_TRUNC)
+		hflags |= HTIF_O_TRUNC;
+	if (flags & O_APPEND)
+		hflags |= HTIF_O_APPEND;
+	return host_ret(htif_open(name, hflags, mode));
 }
 
 /**
-* This library does not support any file I/O of any kind.
+* Reads from a host file. The standard input is always at EOF.
 *
-* @return EOF.
+* @return The number of bytes read, 0 at EOF, or -1 on error.
 *****************************************************************/
 __attribute__((__used__)) int _read(int file, char *ptr, int len)
 {
+	if (HOST_FD(file))
+		return host_ret(htif_read(file, ptr, len));
 	return 0;
 }
 
 /**
-* This function should satify the caller by simply returning len
-* indicating that the write has succeeded as requested in spite
-* of the fact that the data is simply ignored/discarded.
+* Writes to a host file. Anything written to the standard streams
+* goes to the console.
 *
-* @return len
+* @return len, or -1 on error.
 *****************************************************************/
 __attribute__((__used__)) int _write(int file, char *ptr, int len)
 {
+	if (HOST_FD(file))
+		return host_ret(htif_write(file, ptr, len));
 #ifdef QEMU
 	// qemu-system-riscv32 -machine virt has a 16550 at address 0x10000000
 	//volatile char *thr = (volatile char *)0x10000000;
@@ -11,6 +11,9 @@
  * effective EEMBC Benchmark License Agreement, you must discontinue use.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include "ee_audiomark.h"
 #include "ee_api.h"
 #include "dsp/none.h"
@@ -19,7 +22,9 @@
 
 #include "arm_nnfunctions.h"
 
-// These are the input audio files and some scratchpad
+// These are the input audio files and some scratchpad. A streamed input
+// comes from the host instead, see th_stream.c.
+#ifndef AUDIOMARK_STREAM
 const int16_t downlink_audio[NINPUT_SAMPLES] = {
 #include "ee_data/noise.txt"
 };
@@ -29,47 +34,188 @@ const int16_t left_microphone_capture[NINPUT_SAMPLES] = {
 const int16_t right_microphone_capture[NINPUT_SAMPLES] = {
 #include "ee_data/right0.txt"
 };
-int16_t for_asr[NINPUT_SAMPLES];
+int16_t for_asr[AUDIOMARK_INSTANCES][NINPUT_SAMPLES];
+#endif
 
 // These are the inter-component buffers
-int16_t audio_input[SAMPLES_PER_AUDIO_FRAME];       // 1
-int16_t left_capture[SAMPLES_PER_AUDIO_FRAME];      // 2
-int16_t right_capture[SAMPLES_PER_AUDIO_FRAME];     // 3
-int16_t beamformer_output[SAMPLES_PER_AUDIO_FRAME]; // 4
-int16_t aec_output[SAMPLES_PER_AUDIO_FRAME];        // 5
-int16_t audio_fifo[AUDIO_FIFO_SAMPLES];             // 6
-int8_t  mfcc_fifo[MFCC_FIFO_BYTES];                 // 7
-int8_t  classes[OUT_DIM];                           // 8
+int16_t audio_input[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];       // 1
+int16_t left_capture[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];      // 2
+int16_t right_capture[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];     // 3
+int16_t beamformer_output[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME]; // 4
+int16_t aec_output[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];        // 5
+int16_t audio_fifo[AUDIOMARK_INSTANCES][AUDIO_FIFO_SAMPLES];             // 6
+int8_t  mfcc_fifo[AUDIOMARK_INSTANCES][MFCC_FIFO_BYTES];                 // 7
+int8_t  classes[AUDIOMARK_INSTANCES][OUT_DIM];                           // 8
+
+/*
+ * Working memory comes from one fixed pool per component, placed in the
+ * .th_arena section (see link.ld) instead of the newlib heap, so the memory
+ * footprint of the pipeline shows in the link map. Override the pool sizes
+ * with -DTH_ARENA_<COMPONENT>_SIZE=<bytes> to try smaller parts.
+ *
+ * Each pool is a bump allocator. A pool is reclaimed once all of its blocks
+ * are freed, which is all the components need, and th_free() accepts any
+ * pointer into a block: the AEC and ANR hand back the Speex state, which
+ * Speex aligns inside the block (this made free() crash before).
+ *
+ * Blocks are painted on allocation. When a pool is reclaimed it reports the
+ * bytes requested, the bytes the component actually touched (the last
+ * unpainted byte, Speex clears all it allocates) and its high-water mark.
+ *
+ * Every pipeline of a multi-instance build has pools of its own, picked by
+ * the hart it runs on (see main.c), and so does the NN below.
+ */
+#ifndef TH_ARENA_BMF_SIZE
+#define TH_ARENA_BMF_SIZE (16 * 1024)
+#endif
+#ifndef TH_ARENA_AEC_SIZE
+#define TH_ARENA_AEC_SIZE (67 * 1024)
+#endif
+#ifndef TH_ARENA_ANR_SIZE
+#define TH_ARENA_ANR_SIZE (45 * 1024)
+#endif
+#ifndef TH_ARENA_KWS_SIZE
+#define TH_ARENA_KWS_SIZE (9 * 1024)
+#endif
+
+#define TH_ARENA_ALIGN 16
+#define TH_ARENA_PAINT 0xa5
+
+#define TH_ARENA_POOL(N)                                                   \
+    static uint8_t th_arena_##N[AUDIOMARK_INSTANCES][TH_ARENA_##N##_SIZE] \
+        __attribute__((section(".th_arena." #N), aligned(TH_ARENA_ALIGN)))
+
+TH_ARENA_POOL(BMF);
+TH_ARENA_POOL(AEC);
+TH_ARENA_POOL(ANR);
+TH_ARENA_POOL(KWS);
+
+typedef struct th_arena_t
+{
+    const char *name;
+    uint8_t    *pools;     // one pool per instance
+    size_t      size;      // of each pool
+} th_arena_t;
+
+typedef struct th_arena_use_t
+{
+    size_t used;      // bump offset
+    size_t peak;      // high-water mark of used
+    size_t requested; // sum of the requested sizes
+    int    live;      // blocks not freed yet
+} th_arena_use_t;
+
+static const th_arena_t th_arenas[] = {
+    [COMPONENT_BMF] = { "bmf", &th_arena_BMF[0][0], TH_ARENA_BMF_SIZE },
+    [COMPONENT_AEC] = { "aec", &th_arena_AEC[0][0], TH_ARENA_AEC_SIZE },
+    [COMPONENT_ANR] = { "anr", &th_arena_ANR[0][0], TH_ARENA_ANR_SIZE },
+    [COMPONENT_KWS] = { "kws", &th_arena_KWS[0][0], TH_ARENA_KWS_SIZE },
+};
+
+#define TH_ARENAS (sizeof(th_arenas) / sizeof(th_arenas[0]))
+
+static th_arena_use_t th_arena_uses[AUDIOMARK_INSTANCES][TH_ARENAS];
+
+/* The instance the calling hart runs, see main.c */
+static uint32_t
+th_instance(void)
+{
+#if AUDIOMARK_INSTANCES > 1
+    uint32_t hart;
+    asm volatile("csrr %0, mhartid" : "=r"(hart));
+    return hart;
+#else
+    return 0;
+#endif
+}
+
+static const th_arena_t *
+th_arena(int req)
+{
+    if (req < 0 || req >= (int)TH_ARENAS || th_arenas[req].pools == NULL)
+    {
+        return NULL;
+    }
+    return &th_arenas[req];
+}
 
 void *
 th_malloc(size_t size, int req)
 {
-    switch (req)
+    const th_arena_t *p_arena  = th_arena(req);
+    uint32_t          instance = th_instance();
+    th_arena_use_t   *p_use;
+    size_t            offset;
+    uint8_t          *p_mem;
+
+    if (p_arena == NULL)
+    {
+        return NULL;
+    }
+    p_use  = &th_arena_uses[instance][req];
+    offset = (p_use->used + TH_ARENA_ALIGN - 1) & ~(size_t)(TH_ARENA_ALIGN - 1);
+    if (size > p_arena->size || offset > p_arena->size - size)
+    {
+        printf("th_malloc: %s pool of %lu bytes can't fit %lu more bytes\n",
+               p_arena->name,
+               (unsigned long)p_arena->size,
+               (unsigned long)size);
+        return NULL;
+    }
+    p_mem = p_arena->pools + instance * p_arena->size + offset;
+    memset(p_mem, TH_ARENA_PAINT, size);
+    p_use->used = offset + size;
+    if (p_use->used > p_use->peak)
     {
-        // The system integrator can assign working memory wherever they like
-        case COMPONENT_BMF:
-        case COMPONENT_AEC:
-        case COMPONENT_ANR:
-        case COMPONENT_KWS:
-        default:
-            return malloc(size);
+        p_use->peak = p_use->used;
     }
+    p_use->requested += size;
+    p_use->live++;
+    return p_mem;
 }
 
 void
 th_free(void *mem, int req)
 {
-    return; // FIXME For some reason this was crashing so it's commented out
-    // switch (req)
-    // {
-    //     // The system integrator can assign working memory wherever they like
-    //     case COMPONENT_BMF:
-    //     case COMPONENT_AEC:
-    //     case COMPONENT_ANR:
-    //     case COMPONENT_KWS:
-    //     default:
-    //         free(mem);
-    // }
+    const th_arena_t *p_arena  = th_arena(req);
+    uint32_t          instance = th_instance();
+    th_arena_use_t   *p_use;
+    uint8_t          *base;
+    size_t            touched;
+
+    if (p_arena == NULL || mem == NULL)
+    {
+        return;
+    }
+    p_use = &th_arena_uses[instance][req];
+    base  = p_arena->pools + instance * p_arena->size;
+    if (p_use->live == 0)
+    {
+        return;
+    }
+    if ((uint8_t *)mem < base || (uint8_t *)mem >= base + p_arena->size)
+    {
+        printf("th_free: %p is not in the %s pool\n", mem, p_arena->name);
+        return;
+    }
+    if (--p_use->live > 0)
+    {
+        return;
+    }
+
+    for (touched = p_use->peak;
+         touched > 0 && base[touched - 1] == TH_ARENA_PAINT;
+         --touched)
+    {
+    }
+    printf("Memory %s : %lu requested, %lu touched, %lu high-water of %lu\n",
+           p_arena->name,
+           (unsigned long)p_use->requested,
+           (unsigned long)touched,
+           (unsigned long)p_use->peak,
+           (unsigned long)p_arena->size);
+    p_use->used      = 0;
+    p_use->requested = 0;
 }
 
 void *
@@ -134,6 +280,8 @@ th_rfft_f32(ee_rfft_f32_t *p_instance,
     arm_rfft_fast_f32(p_instance, p_in, p_out, ifftFlag);
 }
 
+#ifndef TH_API_RVV
+// Replaced by ports/riscv-v/th_dsp_rvv.c
 void
 th_absmax_f32(const ee_f32_t *p_in,
               uint32_t        len,
@@ -168,6 +316,43 @@ th_cmplx_dot_prod_f32(const ee_f32_t *p_a,
     arm_cmplx_dot_prod_f32(p_a, p_b, len, p_r, p_i);
 }
 
+void
+th_cmplx_conj_dot_prod_f32(const ee_f32_t *p_a,
+                           const ee_f32_t *p_b,
+                           uint32_t        len,
+                           ee_f32_t       *p_r,
+                           ee_f32_t       *p_i)
+{
+    ee_f32_t r = 0.0f;
+    ee_f32_t i = 0.0f;
+
+    /* One product at a time, in the order of arm_cmplx_dot_prod_f32() on
+       the conjugate, so the sums round the same way */
+    for (uint32_t j = 0; j < 2 * len; j += 2)
+    {
+        r += p_a[j] * p_b[j];
+        i += p_a[j] * p_b[j + 1];
+        r += p_a[j + 1] * p_b[j + 1];
+        i -= p_a[j + 1] * p_b[j];
+    }
+    *p_r = r;
+    *p_i = i;
+}
+
+void
+th_cmplx_nlms_update_f32(ee_f32_t       *p_w,
+                         const ee_f32_t *p_x,
+                         const ee_f32_t *p_e,
+                         ee_f32_t        mu,
+                         uint32_t        len)
+{
+    for (uint32_t j = 0; j < 2 * len; j += 2)
+    {
+        p_w[j] += mu * (p_e[0] * p_x[j] + p_e[1] * p_x[j + 1]);
+        p_w[j + 1] += mu * (p_e[0] * p_x[j + 1] - p_e[1] * p_x[j]);
+    }
+}
+
 void
 th_int16_to_f32(const int16_t *p_src, ee_f32_t *p_dst, uint32_t len)
 {
@@ -215,12 +400,6 @@ th_offset_f32(ee_f32_t *p_a, ee_f32_t offset, ee_f32_t *p_c, uint32_t len)
     arm_offset_f32(p_a, offset, p_c, len);
 }
 
-void
-th_vlog_f32(ee_f32_t *p_a, ee_f32_t *p_c, uint32_t len)
-{
-    arm_vlog_f32(p_a, p_c, len);
-}
-
 void
 th_mat_vec_mult_f32(ee_matrix_f32_t *p_a, ee_f32_t *p_b, ee_f32_t *p_c)
 {
@@ -231,6 +410,16 @@ th_mat_vec_mult_f32(ee_matrix_f32_t *p_a, ee_f32_t *p_b, ee_f32_t *p_c)
     arm_mat_vec_mult_f32(&m, p_b, p_c);
 }
 
+#endif /* TH_API_RVV */
+
+// logf() per element, also on the RVV port: MFCC and noise suppressor
+// numerics stay those of the reference port
+void
+th_vlog_f32(ee_f32_t *p_a, ee_f32_t *p_c, uint32_t len)
+{
+    arm_vlog_f32(p_a, p_c, len);
+}
+
 extern const int32_t ds_cnn_s_layer_12_fc_bias[12];
 extern const int8_t  ds_cnn_s_layer_12_fc_weights[768];
 extern const int32_t ds_cnn_s_layer_1_conv2d_bias[64];
@@ -287,7 +476,7 @@ typedef int8_t output_tensor_t[12];
 #define IN_OUT_BUFER_1_BYTE_OFFSET (MAX_SIZE_BYTES + MAX_SIZE_BYTES % 4)
 
 // TODO
-static int32_t in_out_buf_main[MAX_NUM_WORDS_IN_OUT];
+static int32_t in_out_buf_main[AUDIOMARK_INSTANCES][MAX_NUM_WORDS_IN_OUT];
 // TODO
 
 /* Get size of additional buffers required by library/framework */
@@ -364,16 +553,18 @@ ds_cnn_s_s8_get_buffer_size(void)
 
 /* Test for a complete int8 DS_CNN_S keyword spotting network from
  * https://github.com/ARM-software/ML-zoo & Tag: 22.02 */
-cmsis_nn_context ctx;
+cmsis_nn_context ctx[AUDIOMARK_INSTANCES];
 
 void
 th_nn_init(void)
 {
+    cmsis_nn_context *p_ctx = &ctx[th_instance()];
+
     // unused const arm_cmsis_nn_status expected = ARM_CMSIS_NN_SUCCESS;
-    ctx.size = ds_cnn_s_s8_get_buffer_size();
+    p_ctx->size = ds_cnn_s_s8_get_buffer_size();
 
     /* N.B. The developer owns this file so they can allocate how they like. */
-    ctx.buf = malloc(ctx.size);
+    p_ctx->buf = malloc(p_ctx->size);
 
     // we don't free in audiomark
 }
@@ -381,11 +572,14 @@ th_nn_init(void)
 ee_status_t
 th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
 {
+    uint32_t          instance = th_instance();
+    cmsis_nn_context *p_ctx    = &ctx[instance];
+    int32_t          *p_in_out = in_out_buf_main[instance];
 
     int8_t *in_out_buf_0
-        = (int8_t *)&in_out_buf_main[IN_OUT_BUFER_0_BYTE_OFFSET >> 2];
+        = (int8_t *)&p_in_out[IN_OUT_BUFER_0_BYTE_OFFSET >> 2];
     int8_t *in_out_buf_1
-        = (int8_t *)&in_out_buf_main[IN_OUT_BUFER_1_BYTE_OFFSET >> 2];
+        = (int8_t *)&p_in_out[IN_OUT_BUFER_1_BYTE_OFFSET >> 2];
     // Layer 0 - Implicit reshape
     // 1x490 is interpreted as 49x10
 
@@ -429,7 +623,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     bias_dims.c    = CONV_0_OUT_CH;
 
     arm_cmsis_nn_status status
-        = arm_convolve_wrapper_s8(&ctx,
+        = arm_convolve_wrapper_s8(p_ctx,
                                   &conv_params,
                                   &quant_params,
                                   &in_out_dim_0,
@@ -473,7 +667,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     // Same for all layers in DS block
     bias_dims.c = in_out_dim_0.c;
 
-    status |= arm_depthwise_conv_wrapper_s8(&ctx,
+    status |= arm_depthwise_conv_wrapper_s8(p_ctx,
                                             &dw_conv_params,
                                             &quant_params,
                                             &in_out_dim_1,
@@ -506,7 +700,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     quant_params.multiplier = (int32_t *)ds_cnn_s_layer_3_conv2d_output_mult;
     quant_params.shift      = (int32_t *)ds_cnn_s_layer_3_conv2d_output_shift;
 
-    status |= arm_convolve_wrapper_s8(&ctx,
+    status |= arm_convolve_wrapper_s8(p_ctx,
                                       &conv_params,
                                       &quant_params,
                                       &in_out_dim_0,
@@ -527,7 +721,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     quant_params.multiplier = (int32_t *)ds_cnn_s_layer_4_dw_conv2d_output_mult;
     quant_params.shift = (int32_t *)ds_cnn_s_layer_4_dw_conv2d_output_shift;
 
-    status |= arm_depthwise_conv_wrapper_s8(&ctx,
+    status |= arm_depthwise_conv_wrapper_s8(p_ctx,
                                             &dw_conv_params,
                                             &quant_params,
                                             &in_out_dim_1,
@@ -546,7 +740,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     quant_params.multiplier = (int32_t *)ds_cnn_s_layer_5_conv2d_output_mult;
     quant_params.shift      = (int32_t *)ds_cnn_s_layer_5_conv2d_output_shift;
 
-    status |= arm_convolve_wrapper_s8(&ctx,
+    status |= arm_convolve_wrapper_s8(p_ctx,
                                       &conv_params,
                                       &quant_params,
                                       &in_out_dim_0,
@@ -567,7 +761,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     quant_params.multiplier = (int32_t *)ds_cnn_s_layer_6_dw_conv2d_output_mult;
     quant_params.shift = (int32_t *)ds_cnn_s_layer_6_dw_conv2d_output_shift;
 
-    status |= arm_depthwise_conv_wrapper_s8(&ctx,
+    status |= arm_depthwise_conv_wrapper_s8(p_ctx,
                                             &dw_conv_params,
                                             &quant_params,
                                             &in_out_dim_1,
@@ -585,7 +779,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     quant_params.multiplier   = (int32_t *)ds_cnn_s_layer_7_conv2d_output_mult;
     quant_params.shift        = (int32_t *)ds_cnn_s_layer_7_conv2d_output_shift;
 
-    status |= arm_convolve_wrapper_s8(&ctx,
+    status |= arm_convolve_wrapper_s8(p_ctx,
                                       &conv_params,
                                       &quant_params,
                                       &in_out_dim_0,
@@ -606,7 +800,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     quant_params.multiplier = (int32_t *)ds_cnn_s_layer_8_dw_conv2d_output_mult;
     quant_params.shift = (int32_t *)ds_cnn_s_layer_8_dw_conv2d_output_shift;
 
-    status |= arm_depthwise_conv_wrapper_s8(&ctx,
+    status |= arm_depthwise_conv_wrapper_s8(p_ctx,
                                             &dw_conv_params,
                                             &quant_params,
                                             &in_out_dim_1,
@@ -624,7 +818,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     quant_params.multiplier = (int32_t *)ds_cnn_s_layer_9_conv2d_output_mult;
     quant_params.shift      = (int32_t *)ds_cnn_s_layer_9_conv2d_output_shift;
 
-    status |= arm_convolve_wrapper_s8(&ctx,
+    status |= arm_convolve_wrapper_s8(p_ctx,
                                       &conv_params,
                                       &quant_params,
                                       &in_out_dim_0,
@@ -654,7 +848,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
     in_out_dim_0.w = AVERAGE_POOL_9_OUTPUT_W;
     in_out_dim_0.c = in_out_dim_1.c;
 
-    status |= arm_avgpool_s8(&ctx,
+    status |= arm_avgpool_s8(p_ctx,
                              &pool_params,
                              &in_out_dim_1,
                              in_out_buf_0,
@@ -690,7 +884,7 @@ th_nn_classify(const input_tensor_t in_data, output_tensor_t out_data)
 
     bias_dims.c = in_out_dim_1.c;
 
-    status |= arm_fully_connected_s8(&ctx,
+    status |= arm_fully_connected_s8(p_ctx,
                                      &fc_params,
                                      &per_tensor_quant_params,
                                      &in_out_dim_0,
@@ -0,0 +1,242 @@
+/* Copyright HighTec EDV-Systeme GmbH 2023
+
+   SPDX-License-Identifier: Apache-2.0 */
+
+/* Streaming input for AUDIOMARK_STREAM builds: the three channels come from
+   WAV files on the host, read through the simulator's syscall proxy (see
+   util.c) instead of being linked into the ELF. Each channel has a double
+   buffer of two blocks of frames. A block is refilled while the pipeline
+   still holds the previous frame in the other one, and a block read is one
+   syscall per channel, so the I/O stays a rounding error in the cycle count
+   (Spike only serves HTIF every few thousand instructions). */
+
+#ifdef AUDIOMARK_STREAM
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ee_audiomark.h"
+#include "ee_api.h"
+#include "util.h"
+
+/* Relative to the simulator's working directory. By default the recordings
+   the embedded clip was cut from, 93600 samples per channel. */
+#ifndef AUDIOMARK_STREAM_DOWNLINK
+#define AUDIOMARK_STREAM_DOWNLINK "src/ee_data/wav/Noise.wav"
+#endif
+#ifndef AUDIOMARK_STREAM_LEFT
+#define AUDIOMARK_STREAM_LEFT "src/ee_data/wav/left0.wav"
+#endif
+#ifndef AUDIOMARK_STREAM_RIGHT
+#define AUDIOMARK_STREAM_RIGHT "src/ee_data/wav/right0.wav"
+#endif
+
+/* Frames per block, 32 frames are half a second of audio */
+#ifndef AUDIOMARK_STREAM_FRAMES
+#define AUDIOMARK_STREAM_FRAMES 32
+#endif
+
+#define STREAM_CHANNELS      3
+#define STREAM_BLOCK_SAMPLES (AUDIOMARK_STREAM_FRAMES * SAMPLES_PER_AUDIO_FRAME)
+
+typedef struct
+{
+    const char *path;
+    int         fd;
+    uint32_t    frames; // Whole frames in the data chunk
+} th_stream_channel_t;
+
+static th_stream_channel_t stream_channels[STREAM_CHANNELS] = {
+    { AUDIOMARK_STREAM_DOWNLINK, -1, 0 },
+    { AUDIOMARK_STREAM_LEFT, -1, 0 },
+    { AUDIOMARK_STREAM_RIGHT, -1, 0 },
+};
+
+static int16_t stream_buffer[STREAM_CHANNELS][2][STREAM_BLOCK_SAMPLES]
+    __attribute__((aligned(16)));
+
+static uint32_t stream_left;  // Frames not read from the files yet
+static uint32_t stream_block; // Block the frames are served from
+static uint32_t stream_next;  // Next frame in that block
+static uint32_t stream_valid; // Frames read into that block
+
+static uint32_t
+th_stream_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int
+th_stream_read_all(int fd, void *p_buf, uint32_t len)
+{
+    uint8_t *p = (uint8_t *)p_buf;
+
+    // The proxy is a plain host read(), which may come back short
+    while (len > 0)
+    {
+        long n = htif_read(fd, p, len);
+        if (n <= 0)
+        {
+            return 1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Leaves the file at the first sample. Only 16 kHz mono 16-bit PCM matches
+   the embedded clip, anything else is refused. */
+static int
+th_stream_parse_wav(th_stream_channel_t *p_ch)
+{
+    uint8_t header[16];
+
+    if (th_stream_read_all(p_ch->fd, header, 12)
+        || memcmp(header, "RIFF", 4) || memcmp(&header[8], "WAVE", 4))
+    {
+        printf("th_stream: %s is not a WAV file\n", p_ch->path);
+        return 1;
+    }
+
+    int have_fmt = 0;
+    while (th_stream_read_all(p_ch->fd, header, 8) == 0)
+    {
+        uint32_t size = th_stream_le32(&header[4]);
+
+        if (memcmp(header, "data", 4) == 0)
+        {
+            if (!have_fmt)
+            {
+                break;
+            }
+            p_ch->frames = size / BYTES_PER_AUDIO_FRAME;
+            return 0;
+        }
+        if (memcmp(header, "fmt ", 4) == 0 && size >= 16)
+        {
+            if (th_stream_read_all(p_ch->fd, header, 16))
+            {
+                break;
+            }
+            // PCM, mono, 16 kHz, 16 bits
+            if (header[0] != 1 || header[1] != 0 || header[2] != 1
+                || header[3] != 0
+                || th_stream_le32(&header[4]) != SAMPLING_FREQ_HZ
+                || header[14] != 16 || header[15] != 0)
+            {
+                printf("th_stream: %s must be 16 kHz mono 16-bit PCM\n",
+                       p_ch->path);
+                return 1;
+            }
+            have_fmt = 1;
+            size -= 16;
+        }
+        // Chunks are padded to an even size
+        if (htif_lseek(p_ch->fd, size + (size & 1), SEEK_CUR) < 0)
+        {
+            break;
+        }
+    }
+    printf("th_stream: %s has no audio\n", p_ch->path);
+    return 1;
+}
+
+/* Fill block "block" of every channel with up to a block of frames */
+static int
+th_stream_fill(uint32_t block)
+{
+    uint32_t frames = stream_left < AUDIOMARK_STREAM_FRAMES
+                          ? stream_left
+                          : AUDIOMARK_STREAM_FRAMES;
+
+    for (int i = 0; i < STREAM_CHANNELS; i++)
+    {
+        if (th_stream_read_all(stream_channels[i].fd,
+                               stream_buffer[i][block],
+                               frames * BYTES_PER_AUDIO_FRAME))
+        {
+            printf("th_stream: reading %s failed\n", stream_channels[i].path);
+            return 1;
+        }
+    }
+    stream_left -= frames;
+    stream_block = block;
+    stream_next  = 0;
+    stream_valid = frames;
+    return 0;
+}
+
+ee_status_t
+th_stream_open(void)
+{
+    stream_left = UINT32_MAX;
+    for (int i = 0; i < STREAM_CHANNELS; i++)
+    {
+        th_stream_channel_t *p_ch = &stream_channels[i];
+
+        p_ch->fd = htif_open(p_ch->path, HTIF_O_RDONLY, 0);
+        if (p_ch->fd < 0)
+        {
+            printf("th_stream: can't open %s\n", p_ch->path);
+            th_stream_close();
+            return EE_STATUS_ERROR;
+        }
+        if (th_stream_parse_wav(p_ch))
+        {
+            th_stream_close();
+            return EE_STATUS_ERROR;
+        }
+        // The channels stop together, at the shortest file
+        if (p_ch->frames < stream_left)
+        {
+            stream_left = p_ch->frames;
+        }
+    }
+    if (th_stream_fill(0))
+    {
+        th_stream_close();
+        return EE_STATUS_ERROR;
+    }
+    return EE_STATUS_OK;
+}
+
+int
+th_stream_frame(const int16_t **pp_downlink,
+                const int16_t **pp_left,
+                const int16_t **pp_right)
+{
+    // The frame handed out last is in the current block, refill the other
+    if (stream_next == stream_valid)
+    {
+        if (stream_left == 0 || th_stream_fill(stream_block ^ 1))
+        {
+            return 0;
+        }
+    }
+
+    uint32_t offset = stream_next * SAMPLES_PER_AUDIO_FRAME;
+    *pp_downlink    = &stream_buffer[0][stream_block][offset];
+    *pp_left        = &stream_buffer[1][stream_block][offset];
+    *pp_right       = &stream_buffer[2][stream_block][offset];
+    stream_next++;
+    return 1;
+}
+
+void
+th_stream_close(void)
+{
+    for (int i = 0; i < STREAM_CHANNELS; i++)
+    {
+        if (stream_channels[i].fd >= 0)
+        {
+            htif_close(stream_channels[i].fd);
+            stream_channels[i].fd = -1;
+        }
+    }
+    stream_left  = 0;
+    stream_next  = 0;
+    stream_valid = 0;
+}
+
+#endif
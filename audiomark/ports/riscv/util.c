@@ -5,6 +5,7 @@
    SPDX-License-Identifier: GPL-3.0-or-later OR Apache-2.0 */
 
 #include "util.h"
+#include "../../../common/pgo_dump.h"
 
 volatile uint64_t tohost __attribute__((section(".htif")));
 volatile uint64_t fromhost __attribute__((section(".htif")));
@@ -47,6 +48,30 @@ void shutdown(int code) {
     while(1) {}
 }
 
+/* The proxy resolves paths relative to AT_FDCWD like openat(2) does */
+#define HTIF_AT_FDCWD -100
+
+int htif_open(const char *path, int flags, int mode) {
+    return (int)syscall(SYS_openat, (uintptr_t)HTIF_AT_FDCWD, (uintptr_t)path,
+                        (uintptr_t)strlen(path) + 1, flags, mode, 0, 0);
+}
+
+int htif_close(int fd) {
+    return (int)syscall(SYS_close, fd, 0, 0, 0, 0, 0, 0);
+}
+
+long htif_read(int fd, void *buf, size_t len) {
+    return (long)syscall(SYS_read, fd, (uintptr_t)buf, len, 0, 0, 0, 0);
+}
+
+long htif_write(int fd, const void *buf, size_t len) {
+    return (long)syscall(SYS_write, fd, (uintptr_t)buf, len, 0, 0, 0, 0);
+}
+
+long htif_lseek(int fd, long offset, int whence) {
+    return (long)syscall(SYS_lseek, fd, offset, whence, 0, 0, 0, 0);
+}
+
 void print(const char *s) {
     syscall(SYS_write, 0, (uintptr_t)s, (uintptr_t)strlen(s), 0, 0, 0, 0);
 }
@@ -57,6 +82,10 @@ void printn(const char *s, int len) {
 
 void __attribute__((noreturn)) tohost_exit(uintptr_t code)
 {
+#if PGO_DUMP
+  if (code == 0)
+    pgo_dump();
+#endif
   tohost = (code << 1) | 1;
   while (1);
 }
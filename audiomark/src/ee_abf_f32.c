@@ -29,14 +29,18 @@ beamformer_f32_init(abf_f32_instance_t *p_inst)
 
     for (int i = 0; i < NFFT / 2 + 1; i++)
     {
-        for (int j = 0; j < LEN_BM_ADF * 2; j++)
+        for (int j = 0; j < LEN_BM_ADF * 2 * 2; j++)
         {
             bf_mem->states_BM_ADF[i][j] = 0;
-            bf_mem->coefs_BM_ADF[i][j]  = 0;
+        }
+        for (int j = 0; j < LEN_BM_ADF * 2; j++)
+        {
+            bf_mem->coefs_BM_ADF[i][j] = 0;
         }
         bf_mem->Norm_out_BM[i] = 0;
         bf_mem->lookBF_out[i]  = 0;
     }
+    bf_mem->head_BM_ADF                = 0;
     bf_mem->GSC_det_avg                = 0;
     bf_mem->adptBF_coefs_update_enable = 0;
 }
@@ -48,34 +52,34 @@ adaptive_beamformer_f32(ee_f32_t                  *bf_cmplx_in_pt,
                         abf_f32_fastdata_params_t *bf_params,
                         abf_f32_fastdata_mem_t    *bf_mem)
 {
-    ee_f32_t adap_out[2], error_out[2];
-    ee_f32_t temp[LEN_BM_ADF * 2];
-    ee_f32_t sum0 = 0.0f;
-    ee_f32_t sum1 = 0.0f;
-
-    // Update delay line for reference signal
-    for (int i = 0; i < NFFT / 2 + 1; i++)
-    {
-        for (int j = (LEN_BM_ADF * 2 - 3); j >= 0; j--)
-        {
-            bf_mem->states_BM_ADF[i][j + 2] = bf_mem->states_BM_ADF[i][j];
-        }
-    }
+    ee_f32_t  adap_out[2], error_out[2];
+    ee_f32_t *states;
+    ee_f32_t  sum0 = 0.0f;
+    ee_f32_t  sum1 = 0.0f;
+    int32_t   head;
+
+    // Update delay line for reference signal: move the head back one sample
+    // and write the new one to both copies
+    head = bf_mem->head_BM_ADF == 0 ? LEN_BM_ADF - 1 : bf_mem->head_BM_ADF - 1;
+    bf_mem->head_BM_ADF = head;
     for (int i = 0; i < NFFT / 2 + 1; i++)
     {
-        bf_mem->states_BM_ADF[i][0] = bm_cmplx_in_pt[2 * i];
-        bf_mem->states_BM_ADF[i][1] = bm_cmplx_in_pt[2 * i + 1];
+        states                     = &bf_mem->states_BM_ADF[i][2 * head];
+        states[0]                  = bm_cmplx_in_pt[2 * i];
+        states[1]                  = bm_cmplx_in_pt[2 * i + 1];
+        states[LEN_BM_ADF * 2]     = bm_cmplx_in_pt[2 * i];
+        states[LEN_BM_ADF * 2 + 1] = bm_cmplx_in_pt[2 * i + 1];
     }
 
     for (int i = 0; i < NFFT / 2 + 1; i++)
     {
+        states = &bf_mem->states_BM_ADF[i][2 * head];
         // adaptive filter
-        th_cmplx_conj_f32(&bf_mem->coefs_BM_ADF[i][0], temp, LEN_BM_ADF);
-        th_cmplx_dot_prod_f32(temp,
-                              &bf_mem->states_BM_ADF[i][0],
-                              LEN_BM_ADF,
-                              &adap_out[0],
-                              &adap_out[1]);
+        th_cmplx_conj_dot_prod_f32(&bf_mem->coefs_BM_ADF[i][0],
+                                   states,
+                                   LEN_BM_ADF,
+                                   &adap_out[0],
+                                   &adap_out[1]);
         // calculate error
         error_out[0] = bf_cmplx_in_pt[2 * i] - adap_out[0];
         error_out[1] = bf_cmplx_in_pt[2 * i + 1] - adap_out[1];
@@ -84,17 +88,8 @@ adaptive_beamformer_f32(ee_f32_t                  *bf_cmplx_in_pt,
         { // update adptBF coefficients
             ee_f32_t tmp = bf_params->alpha_BM_NLMS
                            / (bf_mem->Norm_out_BM[i] + bf_params->ep_GSC);
-            for (int j = 0; j < LEN_BM_ADF * 2; j += 2)
-            {
-                bf_mem->coefs_BM_ADF[i][j]
-                    += tmp
-                       * (error_out[0] * bf_mem->states_BM_ADF[i][j]
-                          + error_out[1] * bf_mem->states_BM_ADF[i][j + 1]);
-                bf_mem->coefs_BM_ADF[i][j + 1]
-                    += tmp
-                       * (error_out[0] * bf_mem->states_BM_ADF[i][j + 1]
-                          - error_out[1] * bf_mem->states_BM_ADF[i][j]);
-            }
+            th_cmplx_nlms_update_f32(
+                &bf_mem->coefs_BM_ADF[i][0], states, error_out, tmp, LEN_BM_ADF);
         }
         adap_cmplx_out_pt[2 * i]     = error_out[0];
         adap_cmplx_out_pt[2 * i + 1] = error_out[1];
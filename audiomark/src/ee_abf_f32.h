@@ -37,8 +37,12 @@ typedef struct abf_f32_fastdata_params_t
 
 typedef struct abf_f32_fastdata_mem_t
 {
-    ee_f32_t states_BM_ADF[NFFT / 2 + 1][LEN_BM_ADF * 2];
+    /* Delay lines, newest first from states_BM_ADF[i][2 * head_BM_ADF]. Each
+       sample is stored twice, LEN_BM_ADF apart, so the lines stay contiguous
+       while the head moves instead of the samples. */
+    ee_f32_t states_BM_ADF[NFFT / 2 + 1][LEN_BM_ADF * 2 * 2];
     ee_f32_t coefs_BM_ADF[NFFT / 2 + 1][LEN_BM_ADF * 2];
+    int32_t  head_BM_ADF;
     ee_f32_t Norm_out_BM[NFFT / 2 + 1];
     ee_f32_t lookBF_out[NFFT / 2 + 1];
     ee_f32_t GSC_det_avg;
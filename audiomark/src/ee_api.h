@@ -27,6 +27,20 @@ void *th_memset(void *b, int c, size_t len);
 
 void *th_memmove(void *restrict dst, const void *restrict src, size_t n);
 
+#ifdef AUDIOMARK_STREAM
+/* Streaming input, replaces the embedded clip. th_stream_open() (re)starts
+   the stream at its first frame. th_stream_frame() points at the next frame
+   of each channel, those stay valid until the call after next, and returns
+   0 once any channel runs out. */
+ee_status_t th_stream_open(void);
+
+int th_stream_frame(const int16_t **pp_downlink,
+                    const int16_t **pp_left,
+                    const int16_t **pp_right);
+
+void th_stream_close(void);
+#endif
+
 void th_nn_init(void);
 
 ee_status_t th_nn_classify(const int8_t p_input[490], int8_t p_output[12]);
@@ -81,6 +95,21 @@ void th_cmplx_dot_prod_f32(const ee_f32_t *p_a,
                            ee_f32_t       *p_r,
                            ee_f32_t       *p_i);
 
+/* R + iI = A* dot B, in one pass. Without a fused kernel a port can do
+   th_cmplx_conj_f32() into a temporary and th_cmplx_dot_prod_f32(). */
+void th_cmplx_conj_dot_prod_f32(const ee_f32_t *p_a,
+                                const ee_f32_t *p_b,
+                                uint32_t        len,
+                                ee_f32_t       *p_r,
+                                ee_f32_t       *p_i);
+
+/* W += mu * E* * X, the complex NLMS coefficient update (E is one complex) */
+void th_cmplx_nlms_update_f32(ee_f32_t       *p_w,
+                              const ee_f32_t *p_x,
+                              const ee_f32_t *p_e,
+                              ee_f32_t        mu,
+                              uint32_t        len);
+
 ee_status_t th_rfft_init_f32(ee_rfft_f32_t *p_instance, int fft_length);
 
 void th_rfft_f32(ee_rfft_f32_t *p_instance,
@@ -13,118 +13,163 @@
 #include <stdio.h>
 #include "ee_audiomark.h"
 
+#ifndef AUDIOMARK_STREAM
 extern const int16_t downlink_audio[NINPUT_SAMPLES];
 extern const int16_t left_microphone_capture[NINPUT_SAMPLES];
 extern const int16_t right_microphone_capture[NINPUT_SAMPLES];
-extern int16_t       for_asr[NINPUT_SAMPLES];
+extern int16_t       for_asr[AUDIOMARK_INSTANCES][NINPUT_SAMPLES];
+#endif
 // System integrator can locate these via the linker map (th_api.c)
-extern int16_t audio_input[SAMPLES_PER_AUDIO_FRAME];       // 1
-extern int16_t left_capture[SAMPLES_PER_AUDIO_FRAME];      // 2
-extern int16_t right_capture[SAMPLES_PER_AUDIO_FRAME];     // 3
-extern int16_t beamformer_output[SAMPLES_PER_AUDIO_FRAME]; // 4
-extern int16_t aec_output[SAMPLES_PER_AUDIO_FRAME];        // 5
-extern int16_t audio_fifo[AUDIO_FIFO_SAMPLES];             // 6
-extern int8_t  mfcc_fifo[MFCC_FIFO_BYTES];                 // 7
-extern int8_t  classes[OUT_DIM];                           // 8
-
-/* These are index pointers used to slide through the input audio stream. */
-static uint32_t idx_microphone_L;
-static uint32_t idx_microphone_R;
-static uint32_t idx_downlink;
-static uint32_t idx_for_asr;
-static uint32_t progress_count;
+extern int16_t audio_input[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];       // 1
+extern int16_t left_capture[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];      // 2
+extern int16_t right_capture[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];     // 3
+extern int16_t beamformer_output[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME]; // 4
+extern int16_t aec_output[AUDIOMARK_INSTANCES][SAMPLES_PER_AUDIO_FRAME];        // 5
+extern int16_t audio_fifo[AUDIOMARK_INSTANCES][AUDIO_FIFO_SAMPLES];             // 6
+extern int8_t  mfcc_fifo[AUDIOMARK_INSTANCES][MFCC_FIFO_BYTES];                 // 7
+extern int8_t  classes[AUDIOMARK_INSTANCES][OUT_DIM];                           // 8
+
+#ifdef SPIKE
+/* Charges the cycles since the previous call to a component, 0 is the frame
+   routing in between, see boardsupport.c */
+extern void stage_trigger(int component);
+#define STAGE_TRIGGER(C) stage_trigger(C)
+#else
+#define STAGE_TRIGGER(C)
+#endif
 
 // These are used by Speex's internal speex_alloc function for custom heaps.
+// They are only live during NODE_RESET, so instances must be initialized one
+// at a time.
 char *spxGlobalHeapPtr;
 char *spxGlobalHeapEnd;
 long  cumulatedMalloc;
 
-/* The above buffers are programmed into these XDAIS structures on init. */
-static xdais_buffer_t xdais_bmf[3];
-static xdais_buffer_t xdais_aec[3];
-static xdais_buffer_t xdais_anr[2];
-static xdais_buffer_t xdais_kws[4];
-
-static void *p_bmf_inst;
-static void *p_aec_inst;
-static void *p_anr_inst;
-static void *p_kws_inst;
-
-static int read_all_audio_data = 0;
+typedef struct
+{
+    /* This is the index used to slide through the input audio stream. */
+    uint32_t idx_frame;
+    uint32_t progress_count;
+    int      read_all_audio_data;
+    /* The current downlink frame, read in place from the input clip */
+    const int16_t *p_downlink;
+
+    /* The buffers are programmed into these XDAIS structures on init. */
+    xdais_buffer_t xdais_bmf[3];
+    xdais_buffer_t xdais_aec[3];
+    xdais_buffer_t xdais_anr[2];
+    xdais_buffer_t xdais_kws[4];
+
+    void *p_bmf_inst;
+    void *p_aec_inst;
+    void *p_anr_inst;
+    void *p_kws_inst;
+} ee_audiomark_instance_t;
+
+static ee_audiomark_instance_t instances[AUDIOMARK_INSTANCES];
 
-static void
-ee_reset_audio(void)
+static int
+ee_reset_audio(ee_audiomark_instance_t *p_inst, uint32_t instance)
 {
-    idx_downlink        = 0;
-    idx_microphone_L    = 0;
-    idx_microphone_R    = 0;
-    idx_for_asr         = 0;
-    read_all_audio_data = 0;
-    progress_count      = 0;
+    p_inst->idx_frame           = 0;
+    p_inst->p_downlink          = audio_input[instance];
+    p_inst->read_all_audio_data = 0;
+    p_inst->progress_count      = 0;
+#ifdef AUDIOMARK_STREAM
+    // Reopened per run, so a run always starts at the first frame
+    th_stream_close();
+    if (th_stream_open() != EE_STATUS_OK)
+    {
+        return 1;
+    }
+#endif
+    return 0;
 }
 
+#ifdef AUDIOMARK_STREAM
+/**
+ * Route the next frame of the input stream, see ee_route_audio() below. The
+ * port owns the input buffers, and as nothing keeps the ASR signal it stays
+ * in aec_output. Returns 1 when the stream has no frame left.
+ */
 static int
-ee_copy_audio(int16_t *pt, int16_t debug)
+ee_route_audio(ee_audiomark_instance_t *p_inst, uint32_t instance)
 {
-    uint32_t      *idx = NULL;
-    const int16_t *src = NULL;
-    int16_t       *dst = NULL;
+    const int16_t *p_left;
+    const int16_t *p_right;
 
-    if (debug > 0)
+    if (!th_stream_frame(&p_inst->p_downlink, &p_left, &p_right))
     {
-        return 0;
+        p_inst->read_all_audio_data = 1;
+        return 1;
     }
+    p_inst->progress_count += SAMPLES_PER_AUDIO_FRAME;
 
-    if (pt == audio_input)
+    // linear feedback of the loudspeaker to the MICs
+    for (int i = 0; i < SAMPLES_PER_AUDIO_FRAME; i++)
     {
-        idx = &idx_downlink;
-        src = &(downlink_audio[*idx]);
-        dst = audio_input;
-        // Only need to increment this once since they all move together
-        progress_count += SAMPLES_PER_AUDIO_FRAME;
+        left_capture[instance][i]  = p_left[i] + p_inst->p_downlink[i];
+        right_capture[instance][i] = p_right[i] + p_inst->p_downlink[i];
     }
-    else if (pt == left_capture)
-    {
-        idx = &idx_microphone_L;
-        src = &(left_microphone_capture[*idx]);
-        dst = left_capture;
-    }
-    else if (pt == right_capture)
-    {
-        idx = &idx_microphone_R;
-        src = &(right_microphone_capture[*idx]);
-        dst = right_capture;
-    }
-    else if (pt == aec_output)
+
+    SETUP_XDAIS(p_inst->xdais_aec[1], p_inst->p_downlink, BYTES_PER_AUDIO_FRAME);
+    return 0;
+}
+#else
+/**
+ * Route the next frame through the pipeline. Nothing is copied: the AEC reads
+ * the downlink straight from the input clip, and the AEC, ANR and KWS work on
+ * the frame's slice of for_asr. Only the microphone captures get buffers of
+ * their own, since the loudspeaker feedback is mixed into them.
+ *
+ * When the clip runs out, the pipeline runs once more on the previous frame's
+ * buffers, with the feedback mixed in a second time. Always returns 0, the
+ * loop stops on read_all_audio_data.
+ */
+static int
+ee_route_audio(ee_audiomark_instance_t *p_inst, uint32_t instance)
+{
+    const int16_t *p_left  = left_capture[instance];
+    const int16_t *p_right = right_capture[instance];
+    int16_t       *p_asr   = aec_output[instance];
+
+    p_inst->progress_count += SAMPLES_PER_AUDIO_FRAME;
+
+    if ((p_inst->progress_count + SAMPLES_PER_AUDIO_FRAME)
+        >= AUDIOMARK_INPUT_SAMPLES)
     {
-        idx = &idx_for_asr;
-        src = aec_output;
-        dst = &(for_asr[*idx]);
+        p_inst->read_all_audio_data = 1;
     }
     else
     {
-        return 1;
+        p_inst->p_downlink = &(downlink_audio[p_inst->idx_frame]);
+        p_left             = &(left_microphone_capture[p_inst->idx_frame]);
+        p_right            = &(right_microphone_capture[p_inst->idx_frame]);
+        p_asr              = &(for_asr[instance][p_inst->idx_frame]);
+        p_inst->idx_frame += SAMPLES_PER_AUDIO_FRAME;
     }
 
-    if ((progress_count + SAMPLES_PER_AUDIO_FRAME) >= NINPUT_SAMPLES)
+    // linear feedback of the loudspeaker to the MICs
+    for (int i = 0; i < SAMPLES_PER_AUDIO_FRAME; i++)
     {
-        read_all_audio_data = 1;
-        return 1;
+        left_capture[instance][i]  = p_left[i] + p_inst->p_downlink[i];
+        right_capture[instance][i] = p_right[i] + p_inst->p_downlink[i];
     }
 
-    if (src != 0)
-    {
-        th_memcpy(dst, src, BYTES_PER_AUDIO_FRAME);
-    }
-
-    *idx += SAMPLES_PER_AUDIO_FRAME;
-
+    SETUP_XDAIS(p_inst->xdais_aec[1], p_inst->p_downlink, BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_aec[2], p_asr, BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_anr[0], p_asr, BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_anr[1], p_asr, BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_kws[0], p_asr, BYTES_PER_AUDIO_FRAME);
     return 0;
 }
+#endif
 
 int
-ee_audiomark_initialize(void)
+ee_audiomark_initialize(uint32_t instance)
 {
+    ee_audiomark_instance_t *p_inst = &instances[instance];
+
     // For dereferencing
     uint32_t *p_req;
 
@@ -135,22 +180,22 @@ ee_audiomark_initialize(void)
 
     uint32_t param_idx = 0;
 
-    SETUP_XDAIS(xdais_bmf[0], left_capture, BYTES_PER_AUDIO_FRAME);
-    SETUP_XDAIS(xdais_bmf[1], right_capture, BYTES_PER_AUDIO_FRAME);
-    SETUP_XDAIS(xdais_bmf[2], beamformer_output, BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_bmf[0], left_capture[instance], BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_bmf[1], right_capture[instance], BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_bmf[2], beamformer_output[instance], BYTES_PER_AUDIO_FRAME);
 
-    SETUP_XDAIS(xdais_aec[0], beamformer_output, BYTES_PER_AUDIO_FRAME);
-    SETUP_XDAIS(xdais_aec[1], audio_input, BYTES_PER_AUDIO_FRAME);
-    SETUP_XDAIS(xdais_aec[2], aec_output, BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_aec[0], beamformer_output[instance], BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_aec[1], audio_input[instance], BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_aec[2], aec_output[instance], BYTES_PER_AUDIO_FRAME);
 
-    SETUP_XDAIS(xdais_anr[0], aec_output, BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_anr[0], aec_output[instance], BYTES_PER_AUDIO_FRAME);
     // N.B.: Output overwrites input.
-    SETUP_XDAIS(xdais_anr[1], aec_output, BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_anr[1], aec_output[instance], BYTES_PER_AUDIO_FRAME);
 
-    SETUP_XDAIS(xdais_kws[0], aec_output, BYTES_PER_AUDIO_FRAME);
-    SETUP_XDAIS(xdais_kws[1], audio_fifo, AUDIO_FIFO_SAMPLES * 2);
-    SETUP_XDAIS(xdais_kws[2], mfcc_fifo, MFCC_FIFO_BYTES);
-    SETUP_XDAIS(xdais_kws[3], classes, OUT_DIM);
+    SETUP_XDAIS(p_inst->xdais_kws[0], aec_output[instance], BYTES_PER_AUDIO_FRAME);
+    SETUP_XDAIS(p_inst->xdais_kws[1], audio_fifo[instance], AUDIO_FIFO_SAMPLES * 2);
+    SETUP_XDAIS(p_inst->xdais_kws[2], mfcc_fifo[instance], MFCC_FIFO_BYTES);
+    SETUP_XDAIS(p_inst->xdais_kws[3], classes[instance], OUT_DIM);
 
     /* Call the components for their memory requests. */
     p_req = &memreq_bmf_f32;
@@ -162,43 +207,62 @@ ee_audiomark_initialize(void)
     p_req = &memreq_kws_f32;
     ee_kws_f32(NODE_MEMREQ, (void **)&p_req, NULL, NULL);
 
-    
+    if (instance == 0)
+    {
         printf("Memory alloc summary:\n");
         printf(" bmf = %d\n", memreq_bmf_f32);
         printf(" aec = %d\n", memreq_aec_f32);
         printf(" anr = %d\n", memreq_anr_f32);
         printf(" kws = %d\n", memreq_kws_f32);
-    
+    }
 
     /* Using our heap `all_instances` assign the instances and requests */
-    p_bmf_inst = th_malloc(memreq_bmf_f32, COMPONENT_BMF);
-    p_aec_inst = th_malloc(memreq_aec_f32, COMPONENT_AEC);
-    p_anr_inst = th_malloc(memreq_anr_f32, COMPONENT_ANR);
+    p_inst->p_bmf_inst = th_malloc(memreq_bmf_f32, COMPONENT_BMF);
+    p_inst->p_aec_inst = th_malloc(memreq_aec_f32, COMPONENT_AEC);
+    p_inst->p_anr_inst = th_malloc(memreq_anr_f32, COMPONENT_ANR);
     // This does not allocate the neural net memory, see th_api.c
-    p_kws_inst = th_malloc(memreq_kws_f32, COMPONENT_KWS);
+    p_inst->p_kws_inst = th_malloc(memreq_kws_f32, COMPONENT_KWS);
 
-    if (!p_bmf_inst || !p_aec_inst || !p_anr_inst || !p_kws_inst)
+    if (!p_inst->p_bmf_inst || !p_inst->p_aec_inst || !p_inst->p_anr_inst
+        || !p_inst->p_kws_inst)
     {
         printf("Out of heap memory\n");
         return 1;
     }
 
-    ee_abf_f32(NODE_RESET, (void **)&p_bmf_inst, 0, NULL);
-    ee_aec_f32(NODE_RESET, (void **)&p_aec_inst, 0, &param_idx);
-    ee_anr_f32(NODE_RESET, (void **)&p_anr_inst, 0, &param_idx);
-    ee_kws_f32(NODE_RESET, (void **)&p_kws_inst, 0, NULL);
+    ee_abf_f32(NODE_RESET, (void **)&p_inst->p_bmf_inst, 0, NULL);
+    ee_aec_f32(NODE_RESET, (void **)&p_inst->p_aec_inst, 0, &param_idx);
+    ee_anr_f32(NODE_RESET, (void **)&p_inst->p_anr_inst, 0, &param_idx);
+    ee_kws_f32(NODE_RESET, (void **)&p_inst->p_kws_inst, 0, NULL);
 
     return 0;
 }
 
 void
-ee_audiomark_release(void)
+ee_audiomark_release(uint32_t instance)
 {
-    th_free(p_bmf_inst, COMPONENT_BMF);
-    th_free(p_aec_inst, COMPONENT_AEC);
-    th_free(p_anr_inst, COMPONENT_ANR);
-    th_free(p_kws_inst, COMPONENT_KWS);
+    ee_audiomark_instance_t *p_inst = &instances[instance];
+
+    th_free(p_inst->p_bmf_inst, COMPONENT_BMF);
+    th_free(p_inst->p_aec_inst, COMPONENT_AEC);
+    th_free(p_inst->p_anr_inst, COMPONENT_ANR);
+    th_free(p_inst->p_kws_inst, COMPONENT_KWS);
     // TODO: De-init NN allocs?
+#ifdef AUDIOMARK_STREAM
+    th_stream_close();
+#endif
+}
+
+uint32_t
+ee_audiomark_input_samples(uint32_t instance)
+{
+#ifdef AUDIOMARK_STREAM
+    // Whatever the last run got through
+    return instances[instance].progress_count;
+#else
+    (void)instance;
+    return AUDIOMARK_INPUT_SAMPLES;
+#endif
 }
 
 #define CHECK(X)         \
@@ -208,29 +272,27 @@ ee_audiomark_release(void)
     }
 
 int
-ee_audiomark_run(void)
+ee_audiomark_run(uint32_t instance)
 {
-    ee_reset_audio();
-    while (!read_all_audio_data)
-    {
-        ee_copy_audio(audio_input, 0);
-        ee_copy_audio(left_capture, 0);
-        ee_copy_audio(right_capture, 0);
+    ee_audiomark_instance_t *p_inst = &instances[instance];
 
-        // linear feedback of the loudspeaker to the MICs
-        for (int i = 0; i < BYTES_PER_AUDIO_FRAME / 2; i++)
+    CHECK(ee_reset_audio(p_inst, instance));
+    while (!p_inst->read_all_audio_data)
+    {
+        if (ee_route_audio(p_inst, instance))
         {
-            left_capture[i]  = left_capture[i] + audio_input[i];
-            right_capture[i] = right_capture[i] + audio_input[i];
+            break;
         }
-
-        CHECK(ee_abf_f32(NODE_RUN, (void **)&p_bmf_inst, xdais_bmf, NULL));
-        CHECK(ee_aec_f32(NODE_RUN, (void **)&p_aec_inst, xdais_aec, NULL));
-        CHECK(ee_anr_f32(NODE_RUN, (void **)&p_anr_inst, xdais_anr, NULL));
-        CHECK(ee_kws_f32(NODE_RUN, (void **)&p_kws_inst, xdais_kws, NULL));
-
-        // save the cleaned audio for ASR
-        ee_copy_audio(aec_output, 0);
+        STAGE_TRIGGER(0);
+
+        CHECK(ee_abf_f32(NODE_RUN, (void **)&p_inst->p_bmf_inst, p_inst->xdais_bmf, NULL));
+        STAGE_TRIGGER(COMPONENT_BMF);
+        CHECK(ee_aec_f32(NODE_RUN, (void **)&p_inst->p_aec_inst, p_inst->xdais_aec, NULL));
+        STAGE_TRIGGER(COMPONENT_AEC);
+        CHECK(ee_anr_f32(NODE_RUN, (void **)&p_inst->p_anr_inst, p_inst->xdais_anr, NULL));
+        STAGE_TRIGGER(COMPONENT_ANR);
+        CHECK(ee_kws_f32(NODE_RUN, (void **)&p_inst->p_kws_inst, p_inst->xdais_kws, NULL));
+        STAGE_TRIGGER(COMPONENT_KWS);
     }
     return 0;
 exit_error:
@@ -87,8 +87,23 @@ int32_t ee_aec_f32(int32_t, void **, void *, void *);
 int32_t ee_anr_f32(int32_t, void **, void *, void *);
 int32_t ee_kws_f32(int32_t, void **, void *, void *);
 
-int  ee_audiomark_initialize(void);
-int  ee_audiomark_run(void);
-void ee_audiomark_release(void);
+/* Independent pipelines, each with its own component instances and
+   buffers. Every entry point below works on one of them. How instances map
+   to cores is up to the port, see main.c. */
+#ifndef AUDIOMARK_INSTANCES
+#define AUDIOMARK_INSTANCES 1
+#endif
+#if AUDIOMARK_INSTANCES < 1
+#error "AUDIOMARK_INSTANCES must be at least 1"
+#endif
+#if defined AUDIOMARK_STREAM && AUDIOMARK_INSTANCES > 1
+#error "AUDIOMARK_STREAM only feeds a single instance"
+#endif
+
+int  ee_audiomark_initialize(uint32_t instance);
+int  ee_audiomark_run(uint32_t instance);
+void ee_audiomark_release(uint32_t instance);
+/* Samples one run processes, varies with the input in streaming mode */
+uint32_t ee_audiomark_input_samples(uint32_t instance);
 
 #endif
@@ -16,4 +16,13 @@
 
 #define NINPUT_SAMPLES 24000
 
+/* Samples processed per iteration. A shorter clip cuts simulation time,
+   main.c scales the score to match. */
+#ifndef AUDIOMARK_INPUT_SAMPLES
+#define AUDIOMARK_INPUT_SAMPLES NINPUT_SAMPLES
+#endif
+#if AUDIOMARK_INPUT_SAMPLES > NINPUT_SAMPLES
+#error "AUDIOMARK_INPUT_SAMPLES is longer than the input clip"
+#endif
+
 #endif
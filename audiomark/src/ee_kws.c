@@ -29,14 +29,17 @@
  * the Audio FIFO must match the 40 ms requirement to the 16 ms input, and
  * maintain the window. To do this, it considers the input data in 4 ms chunks.
  * When 10x 4 ms chunks are available by appending the ANR's 16 ms (4 chunk)
- * buffers, it computes a new MFCC, and then shifts the entire FIFO to discard
- * the first 5x chunks, retaining 5 for the sliding window.
+ * buffers, it computes a new MFCC, and then discards the first 5x chunks,
+ * retaining 5 for the sliding window. The Audio FIFO is a ring of chunks, so
+ * this only moves its head, and the MFCC reads its input across the wrap.
  *
  * Each time the MFCC produces a new frame of features (10), they are added
  * to the MFCC FIFO, and the NN classification is invoked. The MFCC FIFO starts
  * out with zero values (silence), and continues to add new frames until it
  * fills, at which point the the first entry is removed to make way for the
- * next frame of MFCC data.
+ * next frame of MFCC data. The MFCC FIFO is a ring as well, but it holds
+ * every frame twice, NUM_MFCC_FRAMES apart, so the NN input starting at the
+ * head is always contiguous.
  *
  * Assumptions mandated by this benchmark:
  * 1. 16 kHz sample rate with 2-byte (16-bit) time-domain samples.
@@ -52,7 +55,9 @@ ee_kws_init(kws_instance_t *p_inst)
 {
     ee_mfcc_f32_init(&(p_inst->mfcc_inst));
     th_nn_init();
-    p_inst->chunk_idx = 0;
+    p_inst->chunk_idx  = 0;
+    p_inst->chunk_head = 0;
+    p_inst->mfcc_head  = 0;
     return EE_STATUS_OK;
 }
 
@@ -71,26 +76,40 @@ ee_kws_run(kws_instance_t *p_inst,
     }
 
     /* Store the incoming 16ms frame as 4 chunk */
-    th_memcpy(&p_inst->p_audio_fifo[p_inst->chunk_idx * SAMPLES_PER_CHUNK],
-              p_buffer,
-              CHUNKS_PER_INPUT_BUFFER * SAMPLES_PER_CHUNK * BYTES_PER_SAMPLE);
-    p_inst->chunk_idx += CHUNKS_PER_INPUT_BUFFER;
+    for (int i = 0; i < CHUNKS_PER_INPUT_BUFFER; i++)
+    {
+        int chunk = (p_inst->chunk_head + p_inst->chunk_idx) % TOTAL_CHUNKS;
+
+        th_memcpy(&p_inst->p_audio_fifo[chunk * SAMPLES_PER_CHUNK],
+                  &p_buffer[i * SAMPLES_PER_CHUNK],
+                  SAMPLES_PER_CHUNK * BYTES_PER_SAMPLE);
+        p_inst->chunk_idx++;
+    }
 
     if (p_inst->chunk_idx >= CHUNK_WATERMARK)
     {
+        int8_t *p_frame;
+
         /* Shift off the oldest features to make room for the new ones. */
-        th_memmove(p_inst->p_mfcc_fifo,
-                   p_inst->p_mfcc_fifo + FEATURES_PER_FRAME,
-                   (NUM_MFCC_FRAMES - 1) * FEATURES_PER_FRAME);
+        p_inst->mfcc_head = (p_inst->mfcc_head + 1) % NUM_MFCC_FRAMES;
 
         /* Compute a new frames worth of MFCC features */
-        ee_mfcc_f32_compute(
-            &(p_inst->mfcc_inst),
-            p_inst->p_audio_fifo,
-            &p_inst->p_mfcc_fifo[(NUM_MFCC_FRAMES - 1) * FEATURES_PER_FRAME]);
+        p_frame = &p_inst->p_mfcc_fifo[((p_inst->mfcc_head + NUM_MFCC_FRAMES - 1)
+                                        % NUM_MFCC_FRAMES)
+                                       * FEATURES_PER_FRAME];
+        ee_mfcc_f32_compute_ring(&(p_inst->mfcc_inst),
+                                 p_inst->p_audio_fifo,
+                                 TOTAL_CHUNKS * SAMPLES_PER_CHUNK,
+                                 p_inst->chunk_head * SAMPLES_PER_CHUNK,
+                                 p_frame);
+        th_memcpy(p_frame + NUM_MFCC_FRAMES * FEATURES_PER_FRAME,
+                  p_frame,
+                  FEATURES_PER_FRAME);
 
         /* Run the inference */
-        status = th_nn_classify(p_inst->p_mfcc_fifo, p_prediction);
+        status = th_nn_classify(
+            &p_inst->p_mfcc_fifo[p_inst->mfcc_head * FEATURES_PER_FRAME],
+            p_prediction);
 #ifdef DEBUG_PRINTF_CLASSES
         printf("OUTPUT: ");
         char output_class[12][8]
@@ -123,9 +142,8 @@ ee_kws_run(kws_instance_t *p_inst,
 
         /* Shift off the aduio buffer chunks used by the MFCC. */
         p_inst->chunk_idx -= CHUNKS_PER_MFCC_SLIDE;
-        th_memmove(p_inst->p_audio_fifo,
-                   p_inst->p_audio_fifo + SAMPLES_PER_OUTPUT_MFCC,
-                   p_inst->chunk_idx * SAMPLES_PER_CHUNK * BYTES_PER_SAMPLE);
+        p_inst->chunk_head
+            = (p_inst->chunk_head + CHUNKS_PER_MFCC_SLIDE) % TOTAL_CHUNKS;
     }
     return status;
 }
@@ -158,8 +176,7 @@ ee_kws_f32(int32_t command, void **pp_inst, void *p_data, void *p_params)
              * padding is not outside of a memory region.
              */
             uint32_t size = (3 * 4) // See note above
-                            + sizeof(mfcc_instance_t)
-                            + 8; /* TODO : justift this */
+                            + sizeof(kws_instance_t);
             *(uint32_t *)(*pp_inst) = size;
             break;
         }
@@ -194,7 +211,7 @@ ee_kws_f32(int32_t command, void **pp_inst, void *p_data, void *p_params)
 
             CHECK_SIZE(inbuf_size, SAMPLES_PER_INPUT_BUFFER * 2);
             CHECK_SIZE(audio_fifo_size, TOTAL_CHUNKS * SAMPLES_PER_CHUNK * 2);
-            CHECK_SIZE(mfcc_fifo_size, NUM_MFCC_FRAMES * FEATURES_PER_FRAME);
+            CHECK_SIZE(mfcc_fifo_size, 2 * NUM_MFCC_FRAMES * FEATURES_PER_FRAME);
             CHECK_SIZE(predictions_size, OUT_DIM);
 
             status = ee_kws_run(p_inst, p_inbuf, p_predictions, new_inference);
@@ -21,8 +21,10 @@ typedef struct kws_instance_t
 {
     mfcc_instance_t mfcc_inst;
     int16_t        *p_audio_fifo; // [TOTAL_CHUNKS * SAMPLES_PER_CHUNK];
-    int8_t         *p_mfcc_fifo;  // [NUM_MFCC_FRAMES * FEATURES_PER_FRAME];
-    int32_t         chunk_idx;
+    int8_t         *p_mfcc_fifo;  // [2 * NUM_MFCC_FRAMES * FEATURES_PER_FRAME];
+    int32_t         chunk_idx;    // chunks in the audio FIFO
+    int32_t         chunk_head;   // oldest chunk in the audio FIFO
+    int32_t         mfcc_head;    // oldest frame in the MFCC FIFO
 } kws_instance_t;
 
 /* TODO: Coalesce the massive amount of #defines! */
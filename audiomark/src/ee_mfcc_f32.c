@@ -78,10 +78,27 @@ ee_mfcc_f32_compute(mfcc_instance_t *p_inst,
                     const int16_t   *p_audio_data,
                     int8_t          *p_mfcc_out)
 {
+    ee_mfcc_f32_compute_ring(p_inst, p_audio_data, FRAME_LEN, 0, p_mfcc_out);
+}
+
+void
+ee_mfcc_f32_compute_ring(mfcc_instance_t *p_inst,
+                         const int16_t   *p_ring,
+                         uint32_t         ring_len,
+                         uint32_t         start,
+                         int8_t          *p_mfcc_out)
+{
+    /* The frame may wrap around the end of the ring */
+    uint32_t first = ring_len - start < FRAME_LEN ? ring_len - start : FRAME_LEN;
+
     /* TensorFlow way of normalizing .wav data to (-1,1) */
-    for (int i = 0; i < FRAME_LEN; i++)
+    for (uint32_t i = 0; i < first; i++)
+    {
+        p_inst->mfcc_input_frame[i] = (ee_f32_t)p_ring[start + i] / (1 << 15);
+    }
+    for (uint32_t i = first; i < FRAME_LEN; i++)
     {
-        p_inst->mfcc_input_frame[i] = (ee_f32_t)p_audio_data[i] / (1 << 15);
+        p_inst->mfcc_input_frame[i] = (ee_f32_t)p_ring[i - first] / (1 << 15);
     }
 
     /* Pad the remaining frame with zeroes, since FFT_LEN >= FRAME_LEN */
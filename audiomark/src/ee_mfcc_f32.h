@@ -48,8 +48,9 @@ extern const ee_f32_t ee_mfcc_filter_coefs_f32[EE_NUM_MFCC_FILTER_COEFS];
 #define PADDED_FRAME_LEN 1024
 #define FFT_LEN          PADDED_FRAME_LEN
 
-// NUM_FRAMES is in ee_nn_weights.h
-#define MFCC_FIFO_BYTES (NUM_MFCC_FEATURES * NUM_FRAMES)
+// NUM_FRAMES is in ee_nn_weights.h. The KWS keeps two copies of the
+// features, back to back, so the NN input stays contiguous, see ee_kws.c.
+#define MFCC_FIFO_BYTES (NUM_MFCC_FEATURES * NUM_FRAMES * 2)
 
 typedef struct mfcc_instance_t
 {
@@ -61,5 +62,8 @@ typedef struct mfcc_instance_t
 
 ee_status_t ee_mfcc_f32_init(mfcc_instance_t *);
 void        ee_mfcc_f32_compute(mfcc_instance_t *, const int16_t *, int8_t *);
+/* Same, on the FRAME_LEN samples from p_ring[start] of a ring of ring_len */
+void ee_mfcc_f32_compute_ring(
+    mfcc_instance_t *, const int16_t *, uint32_t, uint32_t, int8_t *);
 
 #endif /* __EE_MFCC_H */
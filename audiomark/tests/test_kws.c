@@ -33,8 +33,8 @@ int32_t ee_kws_f32(int32_t command,
                    void   *p_params);
 
 static int16_t        aec_output[256];     // 5
-static int16_t        audio_fifo[13 * 64]; // 6
-static int8_t         mfcc_fifo[490];      // 7
+static int16_t        audio_fifo[AUDIO_FIFO_SAMPLES]; // 6
+static int8_t         mfcc_fifo[MFCC_FIFO_BYTES];     // 7
 static int8_t         classes[12];         // 8
 static xdais_buffer_t xdais[4];
 
@@ -63,8 +63,8 @@ main(int argc, char *argv[])
     }
     inst = (void *)memory;
     SETUP_XDAIS(xdais[0], aec_output, 512);
-    SETUP_XDAIS(xdais[1], audio_fifo, 13 * 64 * 2);
-    SETUP_XDAIS(xdais[2], mfcc_fifo, 490);
+    SETUP_XDAIS(xdais[1], audio_fifo, AUDIO_FIFO_SAMPLES * 2);
+    SETUP_XDAIS(xdais[2], mfcc_fifo, MFCC_FIFO_BYTES);
     SETUP_XDAIS(xdais[3], classes, 12);
 
     ee_kws_f32(NODE_RESET, (void **)&inst, NULL, NULL);
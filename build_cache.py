@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+# Copyright HighTec EDV-Systeme GmbH 2023
+# SPDX-License-Identifier: BSD-1-Clause
+
+# Content-addressed object and executable cache, used as a compiler launcher:
+#
+#     build_cache.py <cc> <args...>
+#
+# Compiles (-c) are keyed on the preprocessed source, links on the contents of
+# every input file, library and linker script, including the start files,
+# C library, libgcc and profile runtimes the driver adds by itself (taken
+# from its `-###` link command, so rebuilding newlib or compiler-rt in place
+# misses the cache). Both keys also include the
+# compiler identity (`cc --version` plus the binary's stat), the argument list,
+# the working directory, since that ends up in the debug info, and the
+# contents of the profiles of PGO builds.
+# Anything we don't understand is passed through to the compiler untouched.
+
+import hashlib
+import os
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+CACHE_DIR = Path(os.environ.get('BUILD_CACHE_DIR', Path(__file__).resolve().parent / '.cache' / 'build'))
+# Bump this to invalidate everything if the key format changes
+KEY_VERSION = b'2'
+
+SOURCE_EXTS = ('.c', '.S', '.cc', '.cpp')
+# Inputs we can't preprocess, or outputs we don't know how to restore
+UNCACHEABLE = ('-E', '-S', '-M', '-MM', '-Map', '--version', '-v', '-###')
+
+
+def sha256_file(path):
+    h = hashlib.sha256()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(1 << 20), b''):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def compiler_identity(cc):
+    cc_path = shutil.which(cc)
+    if not cc_path:
+        return None
+    st = os.stat(cc_path)
+    # `cc --version` costs a process spawn, remember it per compiler binary
+    stamp = hashlib.sha256(f'{cc_path}:{st.st_mtime_ns}:{st.st_size}'.encode()).hexdigest()
+    id_file = CACHE_DIR / 'ids' / stamp
+    if id_file.is_file():
+        return id_file.read_text()
+    version = subprocess.run([cc, '--version'], stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True).stdout
+    identity = f'{stamp}\n{version}'
+    store_bytes(id_file, identity.encode())
+    return identity
+
+
+def store_bytes(dest, data):
+    # Write atomically, ninja and make will happily race us
+    dest.parent.mkdir(parents=True, exist_ok=True)
+    fd, tmp = tempfile.mkstemp(dir=dest.parent)
+    with os.fdopen(fd, 'wb') as f:
+        f.write(data)
+    os.replace(tmp, dest)
+
+
+def store_file(dest, src):
+    dest.parent.mkdir(parents=True, exist_ok=True)
+    fd, tmp = tempfile.mkstemp(dir=dest.parent)
+    os.close(fd)
+    shutil.copy(src, tmp)
+    os.replace(tmp, dest)
+
+
+def split_output(args):
+    """Return (args without the output option, output path)"""
+    rest = []
+    out = None
+    it = iter(args)
+    for a in it:
+        if a == '-o':
+            out = next(it, None)
+        elif a.startswith('-o') and len(a) > 2:
+            out = a[2:]
+        else:
+            rest.append(a)
+    return rest, out
+
+
+def link_inputs(args):
+    """Yield every file a link depends on: inputs, -l libraries and linker scripts"""
+    lib_dirs = []
+    scripts = []
+    libs = []
+    it = iter(args)
+    for a in it:
+        if a.startswith('-Wl,'):
+            sub = a.split(',')[1:]
+            for i, s in enumerate(sub):
+                if s == '-T' and i + 1 < len(sub):
+                    scripts.append(sub[i + 1])
+                elif s.startswith('-T') and len(s) > 2:
+                    scripts.append(s[2:])
+        elif a == '-T':
+            scripts.append(next(it, ''))
+        elif a.startswith('-T'):
+            scripts.append(a[2:])
+        elif a == '-L':
+            lib_dirs.append(next(it, ''))
+        elif a.startswith('-L'):
+            lib_dirs.append(a[2:])
+        elif a.startswith('-l'):
+            libs.append(a[2:])
+        elif not a.startswith('-') and os.path.isfile(a):
+            yield a
+
+    # The linker searches -L directories for scripts as well as libraries
+    for script in scripts:
+        for d in ['.'] + lib_dirs:
+            candidate = os.path.join(d, script)
+            if os.path.isfile(candidate):
+                yield candidate
+                break
+    for lib in libs:
+        for d in lib_dirs:
+            candidate = os.path.join(d, f'lib{lib}.a')
+            if os.path.isfile(candidate):
+                yield candidate
+                break
+
+
+def driver_link_command(cc, args):
+    """Return the linker command line the driver would run for the link
+       "args", or None if it won't tell"""
+    res = subprocess.run([cc, '-###'] + args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    if res.returncode != 0:
+        return None
+    # Commands are the indented lines, the link is the last one
+    cmds = [line for line in res.stdout.splitlines() if line.startswith(' ')]
+    if not cmds:
+        return None
+    # Not the output, which may still be there from the last build
+    return split_output(shlex.split(cmds[-1])[1:])[0]
+
+
+def profile_inputs(args):
+    """Yield the profiles a PGO build reads, a file or a directory of .gcda"""
+    for a in args:
+        for opt in ('-fprofile-use=', '-fprofile-instr-use=', '-fprofile-sample-use='):
+            if a.startswith(opt):
+                path = a[len(opt):]
+                if os.path.isdir(path):
+                    yield from sorted(str(p) for p in Path(path).rglob('*') if p.is_file())
+                elif os.path.isfile(path):
+                    yield path
+
+
+def compute_key(cc, args):
+    """Return the cache key for this invocation, or None if it isn't cacheable"""
+    if any(a in UNCACHEABLE or a.startswith('-Wl,-Map') for a in args):
+        return None
+    rest, out = split_output(args)
+    if not out:
+        return None
+
+    identity = compiler_identity(cc)
+    if identity is None:
+        return None
+
+    h = hashlib.sha256(KEY_VERSION)
+    h.update(identity.encode())
+    h.update(os.getcwd().encode())
+    h.update('\0'.join(rest).encode())
+    for path in profile_inputs(rest):
+        h.update(f'{path}\0{sha256_file(path)}\0'.encode())
+
+    sources = [a for a in rest if a.endswith(SOURCE_EXTS) and os.path.isfile(a)]
+    if '-c' in rest:
+        # Exactly one preprocessable source per object, -MD/-MF are kept so the
+        # dependency file comes out of this step even on a cache hit
+        if len(sources) != 1 or any(a.endswith('.s') for a in rest):
+            return None
+        with tempfile.TemporaryDirectory() as tmp:
+            pp = [cc] + ['-E' if a == '-c' else a for a in rest] + ['-o', os.path.join(tmp, 'pp')]
+            if subprocess.run(pp, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL).returncode != 0:
+                return None
+            h.update(b'compile\0')
+            h.update(sha256_file(os.path.join(tmp, 'pp')).encode())
+    else:
+        # Compile-and-link in one go would need the headers too, don't bother
+        if sources:
+            return None
+        h.update(b'link\0')
+        # The driver's own link command has the files it adds itself, with
+        # the search directories that resolve its -l libraries
+        command = driver_link_command(cc, args)
+        if command is None:
+            return None
+        for path in sorted(set(link_inputs(rest)) | set(link_inputs(command))):
+            h.update(f'{path}\0{sha256_file(path)}\0'.encode())
+
+    return h.hexdigest(), out
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(f'usage: {argv[0]} <cc> <args...>', file=sys.stderr)
+        return 2
+    cc, args = argv[1], argv[2:]
+
+    if os.environ.get('BUILD_CACHE', '1') == '0':
+        return subprocess.run([cc] + args).returncode
+
+    keyed = compute_key(cc, args)
+    if keyed is None:
+        return subprocess.run([cc] + args).returncode
+    key, out = keyed
+
+    entry = CACHE_DIR / key[:2] / key[2:]
+    stderr_entry = entry.with_suffix('.stderr')
+    if entry.is_file():
+        shutil.copy(entry, out)
+        # Replay diagnostics so logs look the same on a hit
+        if stderr_entry.is_file():
+            sys.stderr.write(stderr_entry.read_text())
+        return 0
+
+    res = subprocess.run([cc] + args, stderr=subprocess.PIPE)
+    sys.stderr.buffer.write(res.stderr)
+    if res.returncode == 0 and os.path.isfile(out):
+        if res.stderr:
+            store_bytes(stderr_entry, res.stderr)
+        store_file(entry, out)
+    return res.returncode
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
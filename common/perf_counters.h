@@ -0,0 +1,101 @@
+/* Copyright HighTec EDV-Systeme GmbH 2023
+
+   SPDX-License-Identifier: GPL-3.0-or-later OR Apache-2.0 */
+
+/* Start/stop triggers sampling the RV32 machine counters, shared by the
+   Spike ports of all suites. perf_stop() prints one line per measurement:
+
+       PERF <name> cycles=<n> instret=<n> [hpm3=<n> ...]
+
+   which run_spike.decode_counters() parses. On Spike cycles and instret are
+   (nearly) the same, instret is what to compare codegen with once we run on
+   a timing model. Set PERF_HPM_COUNTERS to sample mhpmcounter3 onwards too,
+   reading a counter the hart doesn't implement traps. */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef PERF_HPM_COUNTERS
+#define PERF_HPM_COUNTERS 0
+#endif
+#if PERF_HPM_COUNTERS > 4
+#error "PERF_HPM_COUNTERS: only mhpmcounter3..6 are supported"
+#endif
+
+struct perf_counters {
+    uint64_t cycles;
+    uint64_t instret;
+    uint64_t hpm[PERF_HPM_COUNTERS + 1];
+};
+
+#define PERF_READ_CSR(reg) ({ unsigned long __tmp; \
+    asm volatile ("csrr %0, " #reg : "=r"(__tmp)); \
+    __tmp; })
+
+/* Re-read the high half in case the low half wrapped in between */
+#define PERF_READ_CSR64(reg) ({ unsigned long __hi, __lo; \
+    do { \
+        __hi = PERF_READ_CSR(reg##h); \
+        __lo = PERF_READ_CSR(reg); \
+    } while (__hi != PERF_READ_CSR(reg##h)); \
+    ((uint64_t)__hi << 32) | __lo; })
+
+static inline void perf_read(struct perf_counters *c)
+{
+    c->cycles = PERF_READ_CSR64(mcycle);
+    c->instret = PERF_READ_CSR64(minstret);
+#if PERF_HPM_COUNTERS > 0
+    c->hpm[0] = PERF_READ_CSR64(mhpmcounter3);
+#endif
+#if PERF_HPM_COUNTERS > 1
+    c->hpm[1] = PERF_READ_CSR64(mhpmcounter4);
+#endif
+#if PERF_HPM_COUNTERS > 2
+    c->hpm[2] = PERF_READ_CSR64(mhpmcounter5);
+#endif
+#if PERF_HPM_COUNTERS > 3
+    c->hpm[3] = PERF_READ_CSR64(mhpmcounter6);
+#endif
+}
+
+static inline void perf_report(const char *name, const struct perf_counters *start,
+                               const struct perf_counters *stop)
+{
+    printf("PERF %s cycles=%llu instret=%llu", name,
+           (unsigned long long)(stop->cycles - start->cycles),
+           (unsigned long long)(stop->instret - start->instret));
+    for (int i = 0; i < PERF_HPM_COUNTERS; i++)
+        printf(" hpm%d=%llu", i + 3, (unsigned long long)(stop->hpm[i] - start->hpm[i]));
+    printf("\n");
+}
+
+/* sum += stop - start, for counts accumulated over many intervals. Report
+   them with perf_report(name, &zero, &sum). */
+static inline void perf_add(struct perf_counters *sum, const struct perf_counters *start,
+                            const struct perf_counters *stop)
+{
+    sum->cycles += stop->cycles - start->cycles;
+    sum->instret += stop->instret - start->instret;
+    for (int i = 0; i < PERF_HPM_COUNTERS; i++)
+        sum->hpm[i] += stop->hpm[i] - start->hpm[i];
+}
+
+/* One measurement at a time per translation unit */
+static struct perf_counters perf_start_sample;
+
+static inline void perf_start(void)
+{
+    perf_read(&perf_start_sample);
+}
+
+static inline void perf_stop(const char *name)
+{
+    struct perf_counters stop;
+    perf_read(&stop);
+    perf_report(name, &perf_start_sample, &stop);
+}
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,172 @@
+/* Copyright HighTec EDV-Systeme GmbH 2023
+
+   SPDX-License-Identifier: GPL-3.0-or-later OR Apache-2.0 */
+
+/* Profile dump of the PGO training builds (PGO=1, see Runner.set_pgo() in
+   run_all.py), shared by the Spike ports of all suites. Their tohost_exit()
+   calls pgo_dump() on a clean exit, which writes the counters through the
+   HTIF syscall proxy onto the host:
+
+       clang -fprofile-instr-generate  pgo.profraw in the simulator's working
+                                       directory, for llvm-profdata merge
+       gcc -fprofile-info-section      pgo-<name>.gcda there for each
+                                       object, see pgo_filename()
+
+   Each training run thus leaves one profile set next to its simulation, and
+   Runner.merge_pgo() sums the sets of all runs. Objects that several
+   binaries share, like Embench's support code, get the counts of all of
+   them. Both runtimes are only asked to serialize their counters, which
+   works with the leanest bare-metal builds of them.
+
+   With PROFILE_WRITE_FILE=1 instead, pgo_dump() runs the runtimes' own
+   writers (__gcov_dump(), __llvm_profile_write_file()), which go through
+   open()/write() and the HTIF-backed newlib stubs in stub.c. This covers
+   --coverage and any other instrumentation the stock runtimes handle, with
+   the file names and merging they usually apply. There is no environment,
+   so GCOV_PREFIX and LLVM_PROFILE_FILE don't apply.
+
+   Includers provide the htif_open()/htif_write()/htif_close() wrappers. */
+
+#ifndef PGO_DUMP_H
+#define PGO_DUMP_H
+
+#if PGO_GENERATE || PROFILE_WRITE_FILE
+#define PGO_DUMP 1
+#endif
+
+#if PROFILE_WRITE_FILE
+
+#ifdef __clang__
+
+int __llvm_profile_write_file(void);
+
+static void pgo_dump(void)
+{
+    __llvm_profile_write_file();
+}
+
+#else
+
+#include <gcov.h>
+
+static void pgo_dump(void)
+{
+    __gcov_dump();
+}
+
+#endif /* __clang__ */
+
+#elif PGO_GENERATE
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static int pgo_open(const char *path)
+{
+    return htif_open(path, HTIF_O_WRONLY | HTIF_O_CREAT | HTIF_O_TRUNC, 0644);
+}
+
+#ifdef __clang__
+
+/* Opts out of the runtime's static initializer, which would register an
+   atexit() writer that needs a file system */
+int __llvm_profile_runtime;
+uint64_t __llvm_profile_get_size_for_buffer(void);
+int __llvm_profile_write_buffer(char *buffer);
+
+static void pgo_dump(void)
+{
+    uint64_t size = __llvm_profile_get_size_for_buffer();
+    char *buffer = malloc(size);
+    if (!buffer || __llvm_profile_write_buffer(buffer))
+        return;
+    int fd = pgo_open("pgo.profraw");
+    if (fd < 0)
+        return;
+    htif_write(fd, buffer, size);
+    htif_close(fd);
+    free(buffer);
+}
+
+#else
+
+#include <gcov.h>
+
+/* -fprofile-info-section=gcov_info, the linker provides the bounds */
+extern const struct gcov_info *const __start_gcov_info[];
+extern const struct gcov_info *const __stop_gcov_info[];
+
+/* libgcov hands out the .gcda contents a word at a time, and every syscall
+   waits for Spike to poll tohost, so batch them */
+static struct {
+    int fd;
+    unsigned len;
+    unsigned char data[4096];
+} pgo_out;
+
+static void pgo_flush(void)
+{
+    htif_write(pgo_out.fd, pgo_out.data, pgo_out.len);
+    pgo_out.len = 0;
+}
+
+/* -fprofile-generate=<dir> makes "name" <dir>/<mangled object path>.gcda,
+   with '#' for the slashes of the object path. The file goes to the
+   simulator's working directory as pgo-<mangled object path>.gcda instead,
+   so that binaries sharing an object don't overwrite each other's counts
+   and merge_pgo() can add them up. */
+static void pgo_filename(const char *name, void *arg)
+{
+    static char path[512] = "pgo-";
+    const char *base = name;
+    unsigned len = 4;
+    pgo_out.fd = -1;
+    if (!name)
+        return;
+    for (; *name; name++)
+        if (*name == '/')
+            base = name + 1;
+    while (*base && len < sizeof(path) - 1)
+        path[len++] = *base++;
+    path[len] = 0;
+    if (!*base)
+        pgo_out.fd = pgo_open(path);
+}
+
+static void pgo_write(const void *data, unsigned n, void *arg)
+{
+    const unsigned char *p = data;
+    if (pgo_out.fd < 0)
+        return;
+    while (n--) {
+        if (pgo_out.len == sizeof(pgo_out.data))
+            pgo_flush();
+        pgo_out.data[pgo_out.len++] = *p++;
+    }
+}
+
+static void *pgo_allocate(unsigned length, void *arg)
+{
+    return malloc(length);
+}
+
+static void pgo_dump(void)
+{
+    const struct gcov_info *const *info = __start_gcov_info;
+    /* Keep the compiler from assuming the bounds are distinct objects */
+    __asm__("" : "+r"(info));
+    for (; info != __stop_gcov_info; info++) {
+        pgo_out.fd = -1;
+        __gcov_info_to_gcda(*info, pgo_filename, pgo_write, pgo_allocate, NULL);
+        if (pgo_out.fd >= 0) {
+            pgo_flush();
+            htif_close(pgo_out.fd);
+        }
+    }
+}
+
+#endif /* __clang__ */
+
+#endif /* PROFILE_WRITE_FILE, PGO_GENERATE */
+
+#endif /* PGO_DUMP_H */
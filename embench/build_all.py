@@ -17,10 +17,12 @@ Build all Embench programs.
 
 
 import argparse
+import concurrent.futures
 import os
 import shutil
 import subprocess
 import sys
+import threading
 
 sys.path.append(
     os.path.join(os.path.abspath(os.path.dirname(__file__)), 'pylib')
@@ -121,6 +123,27 @@ def build_parser():
         default=5,
         help='Timeout used for the compiler and linker invocations'
     )
+    parser.add_argument(
+        '-j', '--jobs',
+        type=int,
+        default=1,
+        help='Number of compilations and links to run concurrently',
+    )
+    parser.add_argument(
+        '--benchmark',
+        action='append',
+        help='Only build this benchmark (may be given more than once)',
+    )
+    parser.add_argument(
+        '--support-only',
+        action='store_true',
+        help='Only compile the support code, no benchmarks',
+    )
+    parser.add_argument(
+        '--skip-support',
+        action='store_true',
+        help='Assume the support code has already been compiled',
+    )
 
     return parser
 
@@ -432,11 +455,33 @@ def set_environ():
         os.environ[key] = gp['env'][key]
 
 
-def compile_file(f_root, srcdir, bindir, suffix='.c'):
+class LogBuffer:
+    """Collects log messages from a compile or link running on a worker
+       thread, so they can be replayed into the log in a fixed order."""
+
+    def __init__(self):
+        self.records = []
+
+    def debug(self, msg):
+        self.records.append((log.debug, msg))
+
+    def info(self, msg):
+        self.records.append((log.info, msg))
+
+    def warning(self, msg):
+        self.records.append((log.warning, msg))
+
+    def replay(self):
+        for emit, msg in self.records:
+            emit(msg)
+        self.records = []
+
+
+def compile_file(f_root, srcdir, bindir, suffix='.c', logger=log):
     """Compile a single C or assembler file, with the given file root, "f_root",
        suffix "suffix", from the source directory, "srcdir", in to the bin
        directory, "bindir" using the general preprocessor and C compilation
-       flags.
+       flags. Messages go to "logger".
 
        Return True if the compilation success, False if it fails. Log
        everything in the event of failure
@@ -460,8 +505,8 @@ def compile_file(f_root, srcdir, bindir, suffix='.c'):
             os.path.getmtime(abs_src) > os.path.getmtime(abs_bin)
     ):
         if gp['verbose']:
-            log.debug('Compiling in directory {bin}'.format(bin=bindir))
-            log.debug(arglist_to_str(arglist))
+            logger.debug('Compiling in directory {bin}'.format(bin=bindir))
+            logger.debug(arglist_to_str(arglist))
 
         try:
             res = subprocess.run(
@@ -472,35 +517,35 @@ def compile_file(f_root, srcdir, bindir, suffix='.c'):
                 timeout=gp['timeout'],
             )
             if res.returncode != 0:
-                log.warning(
+                logger.warning(
                     'Warning: Compilation of {root}{suff} from source directory {src} to binary directory {bin} failed'
                         .format(root=f_root, suff=suffix, src=srcdir, bin=bindir)
                 )
                 succeeded = False
         except subprocess.TimeoutExpired:
-            log.warning(
+            logger.warning(
                 'Warning: Compilation of {root}{suff} from source directory {src} to binary directory {bin} timed out'
                     .format(root=f_root, suff=suffix, src=srcdir, bin=bindir)
             )
             succeeded = False
 
         if not succeeded:
-            log.debug('Command was:')
-            log.debug(arglist_to_str(arglist))
+            logger.debug('Command was:')
+            logger.debug(arglist_to_str(arglist))
 
-            log.debug(res.stdout.decode('utf-8'))
-            log.debug(res.stderr.decode('utf-8'))
+            logger.debug(res.stdout.decode('utf-8'))
+            logger.debug(res.stderr.decode('utf-8'))
 
     return succeeded
 
 
-def compile_benchmark(bench):
-    """Compile the benchmark, "bench".
+def benchmark_sources(bench):
+    """List the files of benchmark, "bench", as argument tuples for
+       compile_file, creating its build directory on the way.
 
-       Return True if all files compile successfully, False otherwise."""
+       Return None if the build directory can't be created."""
     abs_src_b = os.path.join(gp['benchdir'], bench)
     abs_bd_b = os.path.join(gp['bd_benchdir'], bench)
-    succeeded = True
 
     if not os.path.isdir(abs_bd_b):
         try:
@@ -509,22 +554,39 @@ def compile_benchmark(bench):
             log.warning(
                 'Warning: Unable to create build directory for benchmark {bench}'.format(bench=bench)
             )
-            return False
+            return None
 
-    # Compile each file in the benchmark
-    for filename in os.listdir(abs_src_b):
+    # Each C file in the benchmark
+    sources = []
+    for filename in sorted(os.listdir(abs_src_b)):
         f_root, ext = os.path.splitext(filename)
         if ext == '.c':
-            succeeded &= compile_file(f_root, abs_src_b, abs_bd_b)
+            sources.append((f_root, abs_src_b, abs_bd_b))
 
-    return succeeded
+    return sources
 
 
-def compile_support():
-    """Compile all the support code.
+def compile_benchmark(bench):
+    """Compile the benchmark, "bench".
 
        Return True if all files compile successfully, False otherwise."""
+    sources = benchmark_sources(bench)
+    if sources is None:
+        return False
+
     succeeded = True
+    for src in sources:
+        succeeded &= compile_file(*src)
+
+    return succeeded
+
+
+def support_sources():
+    """List all the support code as argument tuples for compile_file, creating
+       build directories on the way.
+
+       Return None if a build directory can't be created."""
+    sources = []
 
     # First the general support
     if not os.path.isdir(gp['bd_supportdir']):
@@ -534,26 +596,24 @@ def compile_support():
             log.warning(
                 'Warning: Unable to create support build directory {supportdir}'.format(supportdir=gp["bd_supportdir"])
             )
-            return False
+            return None
 
-    # Compile each general support file in the benchmark
-    succeeded &= compile_file('beebsc', gp['supportdir'], gp['bd_supportdir'])
-    succeeded &= compile_file('main', gp['supportdir'], gp['bd_supportdir'])
+    # Each general support file in the benchmark
+    sources.append(('beebsc', gp['supportdir'], gp['bd_supportdir']))
+    sources.append(('main', gp['supportdir'], gp['bd_supportdir']))
 
-    # Compile dummy files that are needed
+    # Dummy files that are needed
     for dlib in gp['dummy_libs']:
-        succeeded &= compile_file(
-            'dummy-' + dlib, gp['supportdir'], gp['bd_supportdir']
-        )
+        sources.append(('dummy-' + dlib, gp['supportdir'], gp['bd_supportdir']))
 
-    # Compile architecture, chip and board specific files.  Note that we only
+    # Architecture, chip and board specific files.  Note that we only
     # create the build directory if it is needed here.
     for dirtype in ['arch', 'chip', 'board']:
         # Support directory we are interested in
         dirname = gp[dirtype + 'dir']
         # List of files/subdirectories in that directory
-        filelist = os.listdir(dirname)
-        # Compile every C or assembler source file
+        filelist = sorted(os.listdir(dirname))
+        # Every C or assembler source file
         for filename in filelist:
             root, ext = os.path.splitext(filename)
             full_fn = os.path.join(dirname, filename)
@@ -568,14 +628,29 @@ def compile_support():
                         log.warning(
                             'Warning: Unable to create build directory for {dirname}, {builddir}'.format(dirname=dirname, builddir=builddir)
                         )
-                        return False
+                        return None
+
+                sources.append((root, dirname, builddir, ext))
+
+    return sources
+
+
+def compile_support():
+    """Compile all the support code.
 
-                succeeded &= compile_file(root, dirname, builddir, suffix=ext)
+       Return True if all files compile successfully, False otherwise."""
+    sources = support_sources()
+    if sources is None:
+        return False
+
+    succeeded = True
+    for src in sources:
+        succeeded &= compile_file(*src)
 
     return succeeded
 
 
-def create_link_binlist(abs_bd):
+def create_link_binlist(abs_bd, logger=log):
     """
     Create a list of all the binaries to be linked, including those in the
     specified absolute directory, abs_bd.  The binaries in this directory can
@@ -616,7 +691,7 @@ def create_link_binlist(abs_bd):
         if os.path.isfile(binf):
             binlist.extend(gp['ld_input_pattern'].format(binf).split())
         else:
-            log.warning('Warning: Unable to find support library {binf}'.format(binf=binf))
+            logger.warning('Warning: Unable to find support library {binf}'.format(binf=binf))
             return []
 
     # Add dummy binaries. These must be sorted in alphabetical order
@@ -625,7 +700,7 @@ def create_link_binlist(abs_bd):
         if os.path.isfile(binf):
             binlist.extend(gp['ld_input_pattern'].format(binf).split())
         else:
-            log.warning('Warning: Unable to find dummy library {binf}'.format(binf=binf))
+            logger.warning('Warning: Unable to find dummy library {binf}'.format(binf=binf))
             return []
 
     return binlist
@@ -643,14 +718,14 @@ def create_link_arglist(bench, binlist):
     return arglist
 
 
-def link_benchmark(bench):
-    """Link the benchmark, "bench".
+def link_benchmark(bench, logger=log):
+    """Link the benchmark, "bench". Messages go to "logger".
 
        Return True if link is successful, False otherwise."""
     abs_bd_b = os.path.join(gp['bd_benchdir'], bench)
 
     if not os.path.isdir(abs_bd_b):
-        log.warning(
+        logger.warning(
             'Warning: Unable to find build directory for benchmark {bench}'.format(bench=bench)
         )
         return False
@@ -659,15 +734,15 @@ def link_benchmark(bench):
     succeeded = True
 
     # Create the argument list
-    binlist = create_link_binlist(abs_bd_b)
+    binlist = create_link_binlist(abs_bd_b, logger)
     if not binlist:
         succeeded = False
     arglist = create_link_arglist(bench, binlist)
 
     # Run the link
     if gp['verbose']:
-        log.debug('Linking in directory {abs_bd_b}'.format(abs_bd_b=abs_bd_b))
-        log.debug(arglist_to_str(arglist))
+        logger.debug('Linking in directory {abs_bd_b}'.format(abs_bd_b=abs_bd_b))
+        logger.debug(arglist_to_str(arglist))
 
     try:
         res = subprocess.run(
@@ -678,24 +753,138 @@ def link_benchmark(bench):
             timeout=gp['timeout'],
         )
         if res.returncode != 0:
-            log.warning('Warning: Link of benchmark "{bench}" failed'.format(bench=bench))
+            logger.warning('Warning: Link of benchmark "{bench}" failed'.format(bench=bench))
             succeeded = False
 
-        log.debug(res.stdout.decode('utf-8'))
-        log.debug(res.stderr.decode('utf-8'))
+        logger.debug(res.stdout.decode('utf-8'))
+        logger.debug(res.stderr.decode('utf-8'))
 
     except subprocess.TimeoutExpired:
-        log.warning('Warning: link of benchmark "{bench}" timed out'.format(bench=bench))
+        logger.warning('Warning: link of benchmark "{bench}" timed out'.format(bench=bench))
         succeeded = False
 
     if not succeeded:
-        log.debug('In directory "' + abs_bd_b + '"')
-        log.debug('Command was:')
-        log.debug(arglist_to_str(arglist))
+        logger.debug('In directory "' + abs_bd_b + '"')
+        logger.debug('Command was:')
+        logger.debug(arglist_to_str(arglist))
 
     return succeeded
 
 
+def build_serial(benchmarks, skip_support):
+    """Compile and link everything one file at a time.
+
+       Return True if everything built successfully, False otherwise."""
+    support_ok = True
+    if not skip_support:
+        support_ok = compile_support()
+        if support_ok:
+            log.debug('Compilation of support files successful')
+    successful = support_ok
+
+    for bench in benchmarks:
+        res = compile_benchmark(bench)
+        successful &= res
+        if res:
+            log.debug('Compilation of benchmark "{bench}" successful'.format(bench=bench))
+            # Links need the support objects, as in build_parallel()
+            if not support_ok:
+                continue
+            res = link_benchmark(bench)
+            successful &= res
+            if res:
+                log.debug('Linking of benchmark "{bench}" successful'.format(bench=bench))
+                log.info(bench)
+
+    return successful
+
+
+def build_parallel(benchmarks, skip_support, jobs):
+    """Compile every support and benchmark file on "jobs" worker threads,
+       linking each benchmark as soon as its objects and the support code are
+       ready. Messages are buffered per step and written out in the same order
+       as a serial build, as soon as every earlier step has finished.
+
+       Return True if everything built successfully, False otherwise."""
+    # Directories are created up front, on this thread
+    support = [] if skip_support else support_sources()
+    if support is None:
+        return False
+    bench_srcs = {}
+    successful = True
+    for bench in benchmarks:
+        bench_srcs[bench] = benchmark_sources(bench)
+        if bench_srcs[bench] is None:
+            successful = False
+
+    def compile_step(src):
+        logger = LogBuffer()
+        return compile_file(*src, logger=logger), logger
+
+    def link_step(bench):
+        logger = LogBuffer()
+        return link_benchmark(bench, logger=logger), logger
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs) as executor:
+        support_futs = [executor.submit(compile_step, src) for src in support]
+        compile_futs = {
+            bench: [executor.submit(compile_step, src) for src in srcs]
+            for bench, srcs in bench_srcs.items() if srcs is not None
+        }
+        link_futs = {}
+        link_lock = threading.Lock()
+
+        # Links depend on all support objects, which the benchmarks share.
+        # Without them no benchmark is linked, as in build_serial().
+        support_ok = True
+        for fut in support_futs:
+            res, logger = fut.result()
+            logger.replay()
+            support_ok &= res
+        successful &= support_ok
+        if support_ok and support:
+            log.debug('Compilation of support files successful')
+
+        def try_link(bench):
+            futs = compile_futs[bench]
+            with link_lock:
+                if (support_ok and bench not in link_futs
+                        and all(fut.done() for fut in futs)
+                        and all(fut.result()[0] for fut in futs)):
+                    link_futs[bench] = executor.submit(link_step, bench)
+
+        for bench, futs in compile_futs.items():
+            for fut in futs:
+                fut.add_done_callback(lambda _, bench=bench: try_link(bench))
+
+        # Report in benchmark order, waiting for each one in turn
+        for bench in benchmarks:
+            if bench not in compile_futs:
+                continue
+            res = True
+            for fut in compile_futs[bench]:
+                ok, logger = fut.result()
+                logger.replay()
+                res &= ok
+            successful &= res
+            if not res:
+                continue
+            log.debug('Compilation of benchmark "{bench}" successful'.format(bench=bench))
+            if not support_ok:
+                continue
+            # Callbacks may run before we get here, or not at all for a
+            # benchmark with no sources
+            try_link(bench)
+            res, logger = link_futs[bench].result()
+            logger.replay()
+            successful &= res
+            if res:
+                log.debug('Linking of benchmark "{bench}" successful'.format(bench=bench))
+                log.info(bench)
+
+    return successful
+
+
 def main():
     """Main program to drive building of benchmarks."""
     # Establish the root directory of the repository, since we know this file is
@@ -719,6 +908,14 @@ def main():
 
     # Find the benchmarks
     benchmarks = find_benchmarks()
+    if args.benchmark:
+        unknown = set(args.benchmark) - set(benchmarks)
+        if unknown:
+            log.error('ERROR: Unknown benchmarks "{bad}": exiting'.format(bad='", "'.join(sorted(unknown))))
+            sys.exit(1)
+        benchmarks = [bench for bench in benchmarks if bench in args.benchmark]
+    if args.support_only:
+        benchmarks = []
     log_benchmarks(benchmarks)
 
     # Establish other global parameters
@@ -731,21 +928,10 @@ def main():
     # Set up additional environment variables.
     set_environ()
 
-    # Track success
-    successful = compile_support()
-    if successful:
-        log.debug('Compilation of support files successful')
-
-    for bench in benchmarks:
-        res = compile_benchmark(bench)
-        successful &= res
-        if res:
-            log.debug('Compilation of benchmark "{bench}" successful'.format(bench=bench))
-            res = link_benchmark(bench)
-            successful &= res
-            if res:
-                log.debug('Linking of benchmark "{bench}" successful'.format(bench=bench))
-                log.info(bench)
+    if args.jobs > 1:
+        successful = build_parallel(benchmarks, args.skip_support, args.jobs)
+    else:
+        successful = build_serial(benchmarks, args.skip_support)
 
     if successful:
         log.info('All benchmarks built successfully')
@@ -5,6 +5,7 @@
    SPDX-License-Identifier: GPL-3.0-or-later OR Apache-2.0 */
 
 #include <stdio.h>
+#include "../../../../../common/perf_counters.h"
 
 unsigned long long start;
 extern void _exit(int i);
@@ -18,6 +19,8 @@ extern void _exit(int i);
 void __attribute__ ((noinline)) __attribute__ ((externally_visible))
 start_trigger ()
 {
+    /* Before the timestamp, so the score doesn't include it */
+    perf_start();
     unsigned long hi = read_csr(mcycleh);
     unsigned long lo = read_csr(mcycle);
     start = (unsigned long long)(((CORETIMETYPE)hi) << 32) | lo;
@@ -29,6 +32,7 @@ stop_trigger ()
     unsigned long hi = read_csr(mcycleh);
     unsigned long lo = read_csr(mcycle);
     unsigned long long end = (unsigned long long)(((CORETIMETYPE)hi) << 32) | lo;
+    perf_stop("embench");
     printf("Spike mcycle timer delta: %llu\n", end - start);
     _exit(0);
 }
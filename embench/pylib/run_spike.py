@@ -20,19 +20,31 @@ __all__ = [
     'get_target_args',
     'build_benchmark_cmd',
     'decode_results',
+    'decode_counters',
 ]
 
 import argparse
+import os
 import re
 
 from embench_core import log
+from spike_profile import profile_cmd
 
 
 def get_target_args(remnant):
     """Parse left over arguments"""
     parser = argparse.ArgumentParser(description='Get target specific args')
+    parser.add_argument(
+        '--profile',
+        action='store_true',
+        help='Write a flat per-function profile to <benchmark>.prof',
+    )
+    parser.add_argument(
+        '--snapshot',
+        action='store_true',
+        help='Resume from snapshot/resume.elf made by spike_snapshot.py',
+    )
 
-    # No target arguments
     return parser.parse_args(remnant)
 
 
@@ -44,7 +56,18 @@ def build_benchmark_cmd(bench, args):
     # a command that records both the return value and execution time to
     # stdin/stdout. Obviously using time will not be very precise.
     # Hacky workaround for https://github.com/riscv-software-src/riscv-isa-sim/issues/1493
-    return ['script', '-c', f'spike --isa=RV32GC {bench}', '-e']
+    # The snapshot starts at start_trigger with the same memory contents
+    elf = os.path.join('snapshot', 'resume.elf') if args.snapshot else bench
+    if args.profile:
+        # Spike's instruction log between start_trigger and stop_trigger,
+        # not worth caching. Symbols come from the benchmark itself.
+        return profile_cmd(bench, ['spike', '--isa=RV32GC', elf], f'{bench}.prof')
+    cmd = ['script', '-c', f'spike --isa=RV32GC {elf}', '-e']
+    # Memoize on the ELF hash if the harness provides sim_cache.py
+    launcher = os.environ.get('SIM_LAUNCHER')
+    if launcher:
+        cmd = [launcher, elf, '--'] + cmd
+    return cmd
 
 
 def decode_results(stdout_str, stderr_str):
@@ -66,3 +89,16 @@ def decode_results(stdout_str, stderr_str):
     # We must have failed to find a time
     log.debug('Warning: Failed to find timing')
     return 0.0
+
+
+def decode_counters(stdout_str):
+    """Extract the counter deltas printed by perf_stop() in
+       common/perf_counters.h. Return a dictionary mapping each measurement
+       name to a dictionary of counter name to value, e.g.
+       {'embench': {'cycles': 1234, 'instret': 1200}}"""
+    counters = {}
+    for match in re.finditer(r'^PERF (\S+)((?: \w+=\d+)+)\s*$', stdout_str, re.M):
+        counters[match.group(1)] = {
+            key: int(val) for key, val in re.findall(r'(\w+)=(\d+)', match.group(2))
+        }
+    return counters
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+
+# Flat per-function instruction profile of a program run on spike.
+
+# Copyright (C) 2023 HighTec edV-Systeme GmbH
+#
+# This file is part of Embench.
+
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+"""
+Run a spike command with its instruction log (-l) going to a FIFO, count the
+executed PCs between two trigger symbols and write a flat profile. Only the
+per-PC counts are kept in memory, since full logs are tens of GB. Used as a
+launcher in front of the spike command:
+
+    spike_profile.py [--start SYM] [--stop SYM] [-o FILE] <elf> -- spike ...
+
+The program's own output is passed through, so the usual result scraping
+keeps working.
+"""
+
+__all__ = [
+    'profile_cmd',
+    'read_profile',
+]
+
+import argparse
+import bisect
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+import threading
+from collections import Counter
+
+
+def profile_cmd(elf, spike_cmd, out, start='start_trigger', stop='stop_trigger'):
+    """Return the command profiling "spike_cmd" (a list starting with the
+       spike executable) of program "elf", writing the profile to "out"."""
+    return [sys.executable, os.path.abspath(__file__),
+            '--start', start, '--stop', stop, '-o', out, elf, '--'] + spike_cmd
+
+
+def read_profile(path):
+    """Read a profile written by this module. Return a dictionary mapping
+       symbol to instruction count."""
+    profile = {}
+    with open(path) as fileh:
+        for line in fileh:
+            if line.startswith('#') or not line.strip():
+                continue
+            count, _, sym = line.split(None, 2)
+            profile[sym.rstrip('\n')] = int(count)
+    return profile
+
+
+def load_symbols(elf):
+    """Return the sorted start addresses, sizes and names of all functions in
+       "elf", and the address of every symbol by name."""
+    import lief
+
+    binary = lief.parse(elf)
+    funcs = []
+    addrs = {}
+    for sym in binary.symbols:
+        if not sym.name:
+            continue
+        addrs.setdefault(sym.name, sym.value)
+        # SYMBOL_TYPES.FUNC or Symbol.TYPE.FUNC, depending on the lief version
+        if str(sym.type).endswith('FUNC'):
+            funcs.append((sym.value, sym.size, sym.name))
+    funcs.sort()
+    return funcs, addrs
+
+
+def count_pcs(log, start, stop):
+    """Count executed PCs in spike log stream "log", only between reaching
+       address "start" and address "stop". Return a Counter of PC tokens and a
+       dictionary of PC token to address."""
+    counts = Counter()
+    # 0 plain instruction, 1 start trigger, 2 stop trigger
+    kinds = {}
+    active = False
+    for line in log:
+        # core   0: 0x80000000 (0x00000297) auipc   t0, 0x0
+        parts = line.split(None, 3)
+        if len(parts) < 3:
+            continue
+        tok = parts[2]
+        kind = kinds.get(tok)
+        if kind is None:
+            if not tok.startswith('0x'):
+                # Exceptions, symbol markers and the like
+                continue
+            pc = int(tok, 16)
+            kind = 1 if pc == start else 2 if pc == stop else 0
+            kinds[tok] = kind
+        if kind == 1:
+            active = True
+        elif kind == 2:
+            active = False
+        if active:
+            counts[tok] += 1
+    return counts, {tok: int(tok, 16) for tok in counts}
+
+
+def symbolize(counts, pcs, funcs):
+    """Fold per-PC "counts" into per-function counts"""
+    starts = [f[0] for f in funcs]
+    profile = Counter()
+    for tok, count in counts.items():
+        pc = pcs[tok]
+        i = bisect.bisect_right(starts, pc) - 1
+        if i >= 0 and (pc < funcs[i][0] + funcs[i][1] or funcs[i][1] == 0):
+            profile[funcs[i][2]] += count
+        else:
+            profile['[unknown]'] += count
+    return profile
+
+
+def write_profile(path, profile):
+    total = sum(profile.values())
+    with open(path, 'w') as fileh:
+        fileh.write(f'# {total} instructions\n')
+        fileh.write('# instructions  percent  symbol\n')
+        for sym, count in profile.most_common():
+            fileh.write(f'{count:14}  {count / total:7.2%}  {sym}\n')
+
+
+def run(elf, spike_cmd, out, start, stop):
+    funcs, addrs = load_symbols(elf)
+    for sym in (start, stop):
+        if sym not in addrs:
+            print(f'{sys.argv[0]}: symbol {sym} not found in {elf}', file=sys.stderr)
+            return 1
+
+    with tempfile.TemporaryDirectory() as tmp:
+        fifo = os.path.join(tmp, 'log')
+        os.mkfifo(fifo)
+        result = {}
+
+        def reader():
+            with open(fifo, errors='replace') as log:
+                result['counts'] = count_pcs(log, addrs[start], addrs[stop])
+
+        thread = threading.Thread(target=reader)
+        thread.start()
+        cmd = spike_cmd[:1] + ['-l', f'--log={fifo}'] + spike_cmd[1:]
+        # Same tty workaround as in run_spike.build_benchmark_cmd
+        res = subprocess.run(['script', '-q', '-c', shlex.join(cmd), '-e', '/dev/null'])
+        if thread.is_alive() and 'counts' not in result:
+            # Spike died before opening the log, unblock the reader's open()
+            try:
+                os.close(os.open(fifo, os.O_WRONLY | os.O_NONBLOCK))
+            except OSError:
+                pass
+        thread.join()
+
+    if res.returncode == 0:
+        counts, pcs = result['counts']
+        write_profile(out, symbolize(counts, pcs, funcs))
+    return res.returncode
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Profile a program on spike')
+    parser.add_argument('--start', default='start_trigger',
+                        help='Start counting when reaching this symbol')
+    parser.add_argument('--stop', default='stop_trigger',
+                        help='Stop counting when reaching this symbol')
+    parser.add_argument('-o', '--output', help='Profile file, default <elf>.prof')
+    parser.add_argument('elf', help='Program being run')
+    parser.add_argument('cmd', nargs=argparse.REMAINDER,
+                        help='-- followed by the spike command')
+    args = parser.parse_args()
+    if not args.cmd or args.cmd[0] != '--' or len(args.cmd) < 2:
+        parser.error('missing -- <spike command>')
+    return run(args.elf, args.cmd[1:], args.output or args.elf + '.prof',
+               args.start, args.stop)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+
+# Fast-forward a program on spike to its start trigger and resume from there.
+
+# Copyright (C) 2023 HighTec edV-Systeme GmbH
+#
+# This file is part of Embench.
+
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+"""
+Simulate a program with spike's interactive debugger up to a symbol (by
+default start_trigger), read the register file and dump the RAM. These are
+turned into a resume ELF: the RAM image plus a small stub that restores the
+registers and mret's to the saved PC. Running the resume ELF skips the
+C runtime startup and benchmark initialization, which otherwise gets
+simulated again for every repeated or profiled run.
+
+The RAM is taken from the __ram_origin__/__ram_end__ symbols of the linker
+scripts (or the lowest loaded address if __ram_origin__ is unused). Only
+that much memory is given to spike for the snapshot, so the dump stays
+small. The stub goes right after it, which is still inside spike's default
+memory, so the resume ELF runs with the same spike arguments as the
+original program.
+
+    spike_snapshot.py [--start SYM] [--isa ISA] [--cc CC] <elf> <outdir>
+"""
+
+__all__ = [
+    'take',
+]
+
+import argparse
+import os
+import re
+import shlex
+import subprocess
+import sys
+
+XPRS = ['zero', 'ra', 'sp', 'gp', 'tp', 't0', 't1', 't2', 's0', 's1',
+        'a0', 'a1', 'a2', 'a3', 'a4', 'a5', 'a6', 'a7',
+        's2', 's3', 's4', 's5', 's6', 's7', 's8', 's9', 's10', 's11',
+        't3', 't4', 't5', 't6']
+# Set up by crt0 and not touched again before the trigger. fcsr last, it
+# needs mstatus.FS set.
+CSRS = ['mtvec', 'mscratch', 'mie', 'mstatus', 'fcsr']
+
+MSTATUS_MIE = 1 << 3
+MSTATUS_MPIE = 1 << 7
+MSTATUS_MPP = 3 << 11
+
+
+def flen(isa):
+    """Return the floating point register width of "isa" in bytes"""
+    base = isa.lower().split('_')[0]
+    exts = base[4:] if base.startswith(('rv32', 'rv64')) else base
+    if 'g' in exts or 'd' in exts:
+        return 8
+    if 'f' in exts:
+        return 4
+    return 0
+
+
+def read_symbols(elf, names):
+    import lief
+
+    binary = lief.parse(elf)
+    syms = {}
+    for sym in binary.symbols:
+        if sym.name in names:
+            syms.setdefault(sym.name, sym.value)
+    # PROVIDE()d by the linker scripts, so only there if referenced
+    if '__ram_origin__' in names and '__ram_origin__' not in syms:
+        syms['__ram_origin__'] = min(seg.virtual_address for seg in binary.segments
+                                     if str(seg.type).endswith('LOAD'))
+    missing = set(names) - set(syms)
+    if missing:
+        raise RuntimeError(f'{elf}: missing symbols {", ".join(sorted(missing))}')
+    return syms
+
+
+def memory_arg(layout):
+    return f'-m{layout["ram_origin"]:#x}:{layout["ram_size"]:#x}'
+
+
+def dump_state(elf, isa, layout, start, outdir):
+    """Run "elf" up to address "start" and return its registers, leaving the
+       RAM in outdir/mem.<origin>.bin"""
+    fregs = [f'f{i}' for i in range(32)] if flen(isa) else []
+    cmds = [f'until pc 0 {start:#x}', 'pc 0']
+    cmds += [f'reg 0 {r}' for r in XPRS[1:]]
+    # The debugger only knows the ABI names (ft0, fs0, ...) or the numbers of
+    # FP registers, anything else silently reads f0
+    cmds += [f'freg 0 {i}' for i in range(len(fregs))]
+    cmds += [f'reg 0 {r}' for r in CSRS]
+    cmds += ['dump', 'quit']
+
+    res = subprocess.run(
+        ['spike', '-d', f'--isa={isa}', memory_arg(layout), os.path.abspath(elf)],
+        input='\n'.join(cmds) + '\n',
+        stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT,
+        cwd=outdir,
+        text=True,
+    )
+    # Every query prints one hex value after the prompt, commands without
+    # output leave their prompt on the same line
+    values = re.findall(r'^(?:\s*:)*\s*(0x[0-9a-fA-F]+)\s*$', res.stdout, re.M)
+    names = ['pc'] + XPRS[1:] + fregs + CSRS
+    if len(values) != len(names):
+        raise RuntimeError(f'Unexpected spike debugger output for {elf}:\n{res.stdout}')
+    return {name: int(val, 16) for name, val in zip(names, values)}
+
+
+def resume_source(regs, isa, ram_image):
+    """Return the assembly of the resume ELF"""
+    flen_ = flen(isa)
+    fload = {4: 'flw', 8: 'fld'}.get(flen_)
+    mstatus = regs['mstatus'] & ~(MSTATUS_MIE | MSTATUS_MPIE)
+    mstatus |= MSTATUS_MPP
+    if regs['mstatus'] & MSTATUS_MIE:
+        mstatus |= MSTATUS_MPIE
+
+    lines = [
+        '  .section .snapshot, "awx", @progbits',
+        f'  .incbin "{ram_image}"',
+        '',
+        '  .section .resume, "ax", @progbits',
+        '  .globl _resume',
+        '_resume:',
+    ]
+    for csr in ['mtvec', 'mscratch', 'mie']:
+        lines += [f'  li t0, {regs[csr]:#x}', f'  csrw {csr}, t0']
+    lines += [f'  li t0, {mstatus:#x}', '  csrw mstatus, t0']
+    if fload:
+        lines += [f'  li t0, {regs["fcsr"]:#x}', '  csrw fcsr, t0']
+    lines += [f'  li t0, {regs["pc"]:#x}', '  csrw mepc, t0']
+    lines += ['  la t0, regs']
+    if fload:
+        for i in range(32):
+            lines.append(f'  {fload} f{i}, {i * flen_}(t0)')
+    xbase = 32 * flen_
+    for i, name in enumerate(XPRS):
+        if name not in ('zero', 't0'):
+            lines.append(f'  lw {name}, {xbase + 4 * i}(t0)')
+    lines += [f'  lw t0, {xbase + 4 * XPRS.index("t0")}(t0)', '  mret', '', '  .balign 8', 'regs:']
+    if fload:
+        directive = {4: '.word', 8: '.dword'}[flen_]
+        mask = (1 << (8 * flen_)) - 1
+        for i in range(32):
+            lines.append(f'  {directive} {regs[f"f{i}"] & mask:#x}')
+    for name in XPRS:
+        lines.append(f'  .word {regs.get(name, 0):#x}')
+    return '\n'.join(lines) + '\n'
+
+
+def take(elf, outdir, isa, cc, start='start_trigger'):
+    """Snapshot "elf" at symbol "start" into "outdir", assembling the resume
+       ELF with compiler command "cc" (a list). Return the resume ELF path."""
+    os.makedirs(outdir, exist_ok=True)
+    syms = read_symbols(elf, [start, 'tohost', 'fromhost', '__ram_origin__', '__ram_end__'])
+    layout = {
+        'ram_origin': syms['__ram_origin__'],
+        'ram_size': syms['__ram_end__'] - syms['__ram_origin__'],
+    }
+    regs = dump_state(elf, isa, layout, syms[start], outdir)
+
+    ram_image = f'mem.{layout["ram_origin"]:#x}.bin'
+    with open(os.path.join(outdir, 'resume.S'), 'w') as fileh:
+        fileh.write(resume_source(regs, isa, ram_image))
+    with open(os.path.join(outdir, 'resume.ld'), 'w') as fileh:
+        fileh.write('ENTRY(_resume)\nSECTIONS\n{\n'
+                    f'  . = {layout["ram_origin"]:#x};\n  .snapshot : {{ *(.snapshot) }}\n'
+                    '  .resume : { *(.resume) }\n}\n')
+    # spike finds the HTIF mailboxes by symbol name
+    subprocess.run(
+        cc + ['-nostdlib', '-nostartfiles', '-Tresume.ld',
+              f'-Wl,--defsym=tohost={syms["tohost"]:#x},--defsym=fromhost={syms["fromhost"]:#x}',
+              'resume.S', '-o', 'resume.elf'],
+        cwd=outdir,
+        check=True,
+    )
+    return os.path.join(outdir, 'resume.elf')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Snapshot a program on spike')
+    parser.add_argument('--start', default='start_trigger',
+                        help='Symbol to stop at and snapshot')
+    parser.add_argument('--isa', default='rv32gc', help='spike --isa')
+    parser.add_argument('--cc', default=os.environ.get('CC', 'cc'),
+                        help='Compiler to assemble the resume ELF with')
+    parser.add_argument('elf', help='Program to snapshot')
+    parser.add_argument('outdir', help='Directory for the snapshot')
+    args = parser.parse_args()
+    print(take(args.elf, args.outdir, args.isa, shlex.split(args.cc), args.start))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
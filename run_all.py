@@ -6,11 +6,28 @@ import os
 import subprocess
 import re
 import pathlib
+import shlex
 import shutil
 import argparse
 import json
+import math
+import sys
 import git
 import logging
+from functools import partial
+
+from scheduler import Scheduler
+
+sys.path.append(str(pathlib.Path(__file__).resolve().parent / 'embench' / 'pylib'))
+import run_spike
+import spike_profile
+import spike_snapshot
+
+# Per-benchmark simulation timeout, same as benchmark_speed.py
+EMBENCH_TIMEOUT = 30
+
+# Default host-side input of a streaming AudioMark build, relative to audiomark/
+AUDIOMARK_STREAM_INPUTS = ['src/ee_data/wav/Noise.wav', 'src/ee_data/wav/left0.wav', 'src/ee_data/wav/right0.wav']
 
 def r(args, **kwargs):
     result = subprocess.check_output(args, **kwargs, text=True)
@@ -25,6 +42,19 @@ def extract_score(filename, keyword):
     with open(filename, 'r') as f:
         return extract_nums([line.strip() for line in f.readlines() if keyword in line][0])
 
+def extract_counters(filename, name):
+    # Counter deltas printed by common/perf_counters.h, empty if there are none
+    with open(filename, 'r') as f:
+        return run_spike.decode_counters(f.read()).get(name, {})
+
+def extract_stage_counters(filename, name):
+    # [('total', counters)] followed by the "<name>.<stage>" measurements in
+    # the order they were printed, see audiomark/ports/riscv/boardsupport.c
+    with open(filename, 'r') as f:
+        counters = run_spike.decode_counters(f.read())
+    stages = [(key.split('.', 1)[1], val) for key, val in counters.items() if key.startswith(f'{name}.')]
+    return [('total', counters.get(name, {}))] + stages
+
 def extract_size_score(cwd, keyword):
     # 3 = "dec" column in size output
     return int(extract_score(cwd / 'size.log', keyword)[3])
@@ -35,6 +65,10 @@ def rmdir(x):
 class Runner():
     def __init__(self):
         self.update_env()
+        # Profile jobs by suite, or (suite, sub-benchmark), if PROFILE is set
+        self.profile_jobs = {}
+        # PGO stage of the builds, see set_pgo()
+        self.pgo = None
 
     def update_env(self):
         bash = r("which bash", shell=True).rstrip()
@@ -47,60 +81,310 @@ class Runner():
         self.CFLAGS = os.environ.get('CFLAGS')
         self.LDFLAGS = os.environ.get('LDFLAGS')
         self.CC = os.environ.get('CC')
+        # Compiler launcher that reuses objects and ELFs across runs, set BUILD_CACHE=0 in ./env to disable
+        if os.environ.get('BUILD_CACHE', '1') != '0':
+            os.environ['CC_LAUNCHER'] = str(pathlib.Path(__file__).resolve().parent / 'build_cache.py')
+        else:
+            os.environ.pop('CC_LAUNCHER', None)
+        self.CC_LAUNCHER = os.environ.get('CC_LAUNCHER', '')
+        # Same for simulation results keyed on the ELF hash, SIM_CACHE=0 to disable
+        if os.environ.get('SIM_CACHE', '1') != '0':
+            os.environ['SIM_LAUNCHER'] = str(pathlib.Path(__file__).resolve().parent / 'sim_cache.py')
+        else:
+            os.environ.pop('SIM_LAUNCHER', None)
+        # Set PROFILE=1 in ./env for a flat per-function profile of each benchmark
+        self.PROFILE = os.environ.get('PROFILE', '0') != '0'
+        # Set SNAPSHOT=1 to simulate initialization only once per binary, see spike_snapshot.py
+        self.SNAPSHOT = os.environ.get('SNAPSHOT', '0') != '0'
+        # AUDIOMARK_PORT=riscv-v builds the RVV port, which needs V on Spike too
+        self.AUDIOMARK_ISA = 'rv32gcv' if os.environ.get('AUDIOMARK_PORT') == 'riscv-v' else 'rv32gc'
+        # AUDIOMARK_STREAM=1 reads AudioMark's input from these WAVs at run time, see th_stream.c
+        self.AUDIOMARK_INPUTS = AUDIOMARK_STREAM_INPUTS if os.environ.get('AUDIOMARK_STREAM', '0') != '0' else []
+        # AUDIOMARK_INSTANCES=n runs n AudioMark pipelines on n harts, see audiomark/main.c
+        self.AUDIOMARK_HARTS = int(os.environ.get('AUDIOMARK_INSTANCES', '1'))
+        # COREMARK_HARTS=n runs the CoreMark contexts on n harts, see core_portme.c
+        self.COREMARK_HARTS = int(os.environ.get('COREMARK_HARTS', '1'))
+        # REPEAT=n runs every column n times, the TUI shows the median and
+        # flags relative differences beyond the noise, see stats.py
+        self.REPEAT = max(1, int(os.environ.get('REPEAT', '1')))
+        if self.REPEAT > 1:
+            # Cached results would just repeat the first run
+            os.environ.pop('SIM_LAUNCHER', None)
+        self.repeat_profile = self.PROFILE
+        # Set PGO=1 to also score builds that use the profile of a training run, see set_pgo()
+        self.PGO = os.environ.get('PGO', '0') != '0'
+        self.PROFDATA = os.environ.get('PROFDATA', f'{self.TOOLS}/bin/llvm-profdata')
+        # The gcov-tool next to the compiler, e.g. riscv32-unknown-elf-gcov-tool
+        self.GCOV_TOOL = os.environ.get('GCOV_TOOL', re.sub(r'gcc(-[\d.]+)?$', r'gcov-tool\1', self.CC or 'gcc'))
+        self.PGO_DIR = pathlib.Path(__file__).resolve().parent / '.cache' / 'pgo'
+        # What set_pgo() overrides while training
+        self.pgo_saved = (self.CFLAGS, self.LDFLAGS, self.SNAPSHOT, self.PROFILE, os.environ.get('SIM_LAUNCHER'))
+
+    def set_repeat(self, i):
+        """Prepare repetition "i" of a column. Profiles count instructions,
+           which don't vary between runs, so only the first one takes them."""
+        self.PROFILE = self.repeat_profile and i == 0
+
+
+    def is_clang(self):
+        return 'clang' in r(f'{self.CC} --version', shell=True)
+
+
+    def set_pgo(self, stage):
+        """Switch the builds to come to PGO "stage". 'generate' instruments
+           them, and a clean exit on Spike writes their profile (see
+           common/pgo_dump.h). 'use' optimizes them with the profiles that
+           merge_pgo() gathered. None goes back to plain builds."""
+        cflags, ldflags, snapshot, profile, sim_launcher = self.pgo_saved
+        if stage == 'generate':
+            rmdir(self.PGO_DIR)
+            for run in self.pgo_runs():
+                for f in run:
+                    f.unlink()
+            if self.is_clang():
+                flags = '-fprofile-instr-generate'
+            else:
+                # The .gcda names are mangled from the object paths, and
+                # merge_pgo() puts them where -fprofile-use looks
+                flags = f'-fprofile-generate={self.PGO_DIR / "gcda"} -fprofile-info-section=gcov_info'
+            cflags = f'{cflags} {flags} -DPGO_GENERATE=1'
+            ldflags = f'{ldflags} {flags}'
+            # The training runs have to run for real and from the start
+            snapshot = profile = False
+            sim_launcher = None
+        elif stage == 'use':
+            if self.is_clang():
+                flags = f'-fprofile-instr-use={self.PGO_DIR / "default.profdata"}'
+            else:
+                flags = f'-fprofile-use={self.PGO_DIR / "gcda"} -Wno-missing-profile'
+            cflags = f'{cflags} {flags}'
+            ldflags = f'{ldflags} {flags}'
+        self.CFLAGS, self.LDFLAGS, self.SNAPSHOT, self.PROFILE = cflags, ldflags, snapshot, profile
+        # The build scripts take them from the environment
+        os.environ['CFLAGS'], os.environ['LDFLAGS'] = cflags, ldflags
+        if sim_launcher:
+            os.environ['SIM_LAUNCHER'] = sim_launcher
+        else:
+            os.environ.pop('SIM_LAUNCHER', None)
+        self.profile_jobs = {}
+        self.pgo = stage
+
+
+    def pgo_runs(self):
+        """Profiles written by the training runs, one list per simulation in
+           its working directory: a pgo.profraw for clang, the pgo-*.gcda of
+           all objects of the binary for GCC (see common/pgo_dump.h)"""
+        dirs = [pathlib.Path('Coremark'), pathlib.Path('audiomark')] + sorted(pathlib.Path('embench/bd/src').glob('*'))
+        runs = [sorted(d.glob('pgo.profraw')) + sorted(d.glob('pgo-*.gcda')) for d in dirs]
+        return [run for run in runs if run]
+
+
+    def merge_pgo(self):
+        """Merge the profiles of the training runs for set_pgo('use'). Every
+           run contributes its counts, also to the objects that several
+           binaries share."""
+        runs = self.pgo_runs()
+        if not runs:
+            raise RuntimeError("No PGO training run wrote a profile")
+        self.PGO_DIR.mkdir(parents=True, exist_ok=True)
+        if self.is_clang():
+            r([self.PROFDATA, 'merge', '-o', str(self.PGO_DIR / 'default.profdata')] + [str(f) for run in runs for f in run])
+            return
+        # gcov-tool merges two directories of .gcda files, named as
+        # -fprofile-use expects them, so sum up run by run
+        merged = None
+        for i, run in enumerate(runs):
+            run_dir = self.PGO_DIR / 'runs' / str(i)
+            run_dir.mkdir(parents=True)
+            for f in run:
+                shutil.copyfile(f, run_dir / f.name[len('pgo-'):])
+            if merged is None:
+                merged = run_dir
+                continue
+            out = self.PGO_DIR / 'runs' / f'merged{i}'
+            r([self.GCOV_TOOL, 'merge', '-o', str(out), str(merged), str(run_dir)])
+            merged = out
+        merged.rename(self.PGO_DIR / 'gcda')
+        rmdir(self.PGO_DIR / 'runs')
+
 
     def dump_size(self, bin, cwd):
         r(f'{self.SIZE} {bin} > size.log', cwd=cwd, shell=True)
 
 
-    def run_audiomark(self):
+    def simulate(self, elf, cmd, cwd, log, inputs=()):
+        """Run simulator command "cmd" on "elf" in "cwd", stdout goes to "log".
+           "inputs" are host files the program reads, relative to "cwd"."""
+        # Memoize on the ELF hash if enabled, see sim_cache.py
+        launcher = os.environ.get('SIM_LAUNCHER')
+        if launcher:
+            cmd = [launcher, elf] + list(inputs) + ['--'] + cmd
+        with open(cwd / log, 'w') as f:
+            subprocess.run(cmd, cwd=cwd, stdout=f, check=True)
+
+
+    def snapshot(self, elf, isa, cwd, start='start_trigger'):
+        """Snapshot "elf" in "cwd" at "start" into cwd/snapshot, see spike_snapshot.py"""
+        cc = shlex.split(f'{self.CC} -march=rv32imafdc -mabi=ilp32d {self.CFLAGS}')
+        spike_snapshot.take(str(cwd / elf), str(cwd / 'snapshot'), isa, cc, start)
+
+
+    def add_snapshot(self, sched, name, elf, isa, cwd, built, start='start_trigger'):
+        """Add a snapshot job after "built" if enabled. Return the ELF to
+           simulate and the jobs simulations have to wait for."""
+        if not self.SNAPSHOT:
+            return elf, [built]
+        snap = sched.add(f'{name} snapshot', partial(self.snapshot, elf, isa, cwd, start), [built])
+        return 'snapshot/resume.elf', [snap]
+
+
+    def profile(self, elf, spike_cmd, cwd, out, start='start_trigger', stop='stop_trigger'):
+        """Profile "elf" run by "spike_cmd" in "cwd" into "out", see spike_profile.py"""
+        cmd = spike_profile.profile_cmd(elf, spike_cmd, out, start, stop)
+        subprocess.run(cmd, cwd=cwd, stdout=subprocess.DEVNULL, check=True)
+        return spike_profile.read_profile(cwd / out)
+
+
+    def profile_embench(self, cwd, bench):
+        appdir = cwd / 'bd' / 'src' / bench
+        snapshot = ['--snapshot'] if self.SNAPSHOT else []
+        cmd = run_spike.build_benchmark_cmd(bench, run_spike.get_target_args(['--profile'] + snapshot))
+        subprocess.run(cmd, cwd=appdir, stdout=subprocess.DEVNULL, check=True)
+        return spike_profile.read_profile(appdir / f'{bench}.prof')
+
+
+    def add_audiomark(self, sched):
         cwd = pathlib.Path("audiomark")
-        rmdir(cwd / 'build')
-        r('./build.sh', cwd=cwd, shell=True)
-        # print(f'AudioMark speed,{extract_score(cwd / "run.log", "AudioMarks")[0]}')
-        self.dump_size('build/audiomark', cwd)
-        return ('AudioMark', (extract_score(cwd / "run.log", "AudioMarks")[0], extract_size_score(cwd, 'build/audiomark')))
 
+        def build():
+            rmdir(cwd / 'build')
+            r('./build.sh --no-run', cwd=cwd, shell=True)
+
+        def sim():
+            self.simulate(sim_elf, ['script', '-c', f'spike -p{self.AUDIOMARK_HARTS} --isa={self.AUDIOMARK_ISA} {sim_elf}', '-e'], cwd, 'run.log', self.AUDIOMARK_INPUTS)
+            return extract_score(cwd / "run.log", "AudioMarks")[0], extract_stage_counters(cwd / "run.log", 'audiomark')
 
-    def run_coremark(self):
+        def size():
+            self.dump_size('build/audiomark', cwd)
+            return extract_size_score(cwd, 'build/audiomark')
+
+        built = sched.add('AudioMark build', build, cost=60)
+        if self.AUDIOMARK_INPUTS or self.AUDIOMARK_HARTS > 1:
+            # The snapshot would be taken without the host files, and only
+            # restores hart 0
+            sim_elf, sim_deps = 'build/audiomark', [built]
+        else:
+            sim_elf, sim_deps = self.add_snapshot(sched, 'AudioMark', 'build/audiomark', self.AUDIOMARK_ISA, cwd, built)
+        speed_job = sched.add('AudioMark sim', sim, sim_deps, cost=600)
+        size_job = sched.add('AudioMark size', size, [built])
+        if self.PROFILE:
+            self.profile_jobs['AudioMark'] = sched.add('AudioMark profile', partial(self.profile, 'build/audiomark', ['spike', f'-p{self.AUDIOMARK_HARTS}', f'--isa={self.AUDIOMARK_ISA}', sim_elf], cwd, 'audiomark.prof'), sim_deps, cost=6000)
+        def collect():
+            speed, counters = speed_job.result
+            size = size_job.result
+            # One row per pipeline stage, scored as if the stage ran alone
+            total = counters[0][1].get('cycles')
+            speeds, sizes = [('AudioMarks', speed)], [('total', size)]
+            for stage, c in counters[1:]:
+                speeds.append((stage, speed * total / c['cycles'] if total and c.get('cycles') else 0))
+                sizes.append((stage, size))
+            return ('AudioMark', (speeds, sizes, counters))
+
+        return sched.add('AudioMark', collect, [speed_job, size_job], cost=0)
+
+
+    def add_coremark(self, sched):
         cwd = pathlib.Path("Coremark")
-        r('./coremark-run.sh > run.log', cwd=cwd, shell=True)
-        # print(f'CoreMark speed,{extract_score(cwd / "run.log", "CoreMark 1.0")[1]}')
-        # dump_size('coremark.riscv', cwd)
-        return ('CoreMark', (extract_score(cwd / "run.log", "CoreMark 1.0")[1], extract_size_score(cwd, 'coremark.riscv')))
 
+        def build():
+            r('./coremark-run.sh --no-run', cwd=cwd, shell=True)
+
+        def sim():
+            self.simulate(sim_elf, ['script', '-c', f'spike -p{self.COREMARK_HARTS} --isa=rv32gc_Zicsr {sim_elf}', '-e'], cwd, 'run.log')
+            return extract_score(cwd / "run.log", "CoreMark 1.0")[1], extract_stage_counters(cwd / "run.log", 'coremark')
+
+        def size():
+            self.dump_size('coremark.riscv', cwd)
+            return extract_size_score(cwd, 'coremark.riscv')
 
-    def run_embench(self):
+        built = sched.add('CoreMark build', build, cost=10)
+        if self.COREMARK_HARTS > 1:
+            # The snapshot only restores hart 0
+            sim_elf, sim_deps = 'coremark.riscv', [built]
+        else:
+            # The port has no triggers, start_time/stop_time bracket the timed loop
+            sim_elf, sim_deps = self.add_snapshot(sched, 'CoreMark', 'coremark.riscv', 'rv32gc_Zicsr', cwd, built, 'start_time')
+        speed_job = sched.add('CoreMark sim', sim, sim_deps, cost=60)
+        size_job = sched.add('CoreMark size', size, [built])
+        if self.PROFILE:
+            self.profile_jobs['CoreMark'] = sched.add('CoreMark profile', partial(self.profile, 'coremark.riscv', ['spike', f'-p{self.COREMARK_HARTS}', '--isa=rv32gc_Zicsr', sim_elf], cwd, 'coremark.prof', 'start_time', 'stop_time'), sim_deps, cost=600)
+        def collect():
+            speed, counters = speed_job.result
+            size = size_job.result
+            # With COREMARK_KERNELS=1, one row per kernel, scored as if the
+            # kernel ran alone
+            total = counters[0][1].get('cycles')
+            speeds, sizes = [('CoreMark', speed)], [('total', size)]
+            for kernel, c in counters[1:]:
+                speeds.append((kernel, speed * total / c['cycles'] if total and c.get('cycles') else 0))
+                sizes.append((kernel, size))
+            return ('CoreMark', (speeds, sizes, counters))
+
+        return sched.add('CoreMark', collect, [speed_job, size_job], cost=0)
+
+
+    def sim_embench(self, cwd, bench, target_args):
+        appdir = cwd / 'bd' / 'src' / bench
+        res = subprocess.run(
+            run_spike.build_benchmark_cmd(bench, target_args),
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            cwd=appdir,
+            timeout=EMBENCH_TIMEOUT,
+        )
+        ms = 0.0
+        stdout = res.stdout.decode('utf-8')
+        if res.returncode == 0:
+            ms = run_spike.decode_results(stdout, res.stderr.decode('utf-8'))
+        if ms == 0.0:
+            raise RuntimeError(f"EmBench {bench} failed to run")
+        return ms, run_spike.decode_counters(stdout).get('embench', {})
+
+
+    def add_embench(self, sched):
         cwd = pathlib.Path("embench")
-        for dir in 'bd results logs'.split():
-            rmdir(cwd / dir)
+        # One job per benchmark build and simulation instead of build_all.py
+        # and benchmark_speed.py doing everything, so the scheduler can
+        # interleave them with the other suites
+        benches = sorted(d.name for d in (cwd / 'src').iterdir() if d.is_dir())
+        baseline = json.loads((cwd / 'baseline-data' / 'speed.json').read_text())
+        target_args = run_spike.get_target_args(['--snapshot'] if self.SNAPSHOT else [])
 
         build_args = [
             './build_all.py',
-            '--clean',
             '--verbose',
             '--arch', 'riscv32',
             '--chip=generic',
             '--board=spike',
-            f'--cc={self.CC}',
+            f'--cc={self.CC_LAUNCHER} {self.CC}'.strip(),
             f'--cflags=-O3 -g -ffunction-sections -fdata-sections {self.CFLAGS}',
             f'--ldflags=-Wl,--gc-sections {self.LDFLAGS}',
         ]
-        speed_args = [
-            'python3',
-            './benchmark_speed.py',
-            '--target-module=run_spike',
-            '--json-output',
-        ]
         size_args = [
             'python3',
             './benchmark_size.py',
             '--json-output',
             '--absolute',
         ]
-        
-        _ = r(build_args, cwd=cwd)
-        speed_json = json.loads(r(speed_args, cwd=cwd))
-        size_json = json.loads(r(size_args, cwd=cwd))
+
+        def support():
+            for dir in 'bd results logs'.split():
+                rmdir(cwd / dir)
+            r(build_args + ['--clean', '--support-only'], cwd=cwd)
+
+        def build(bench):
+            # Separate log directories, build_all.py names logs by the second
+            r(build_args + ['--skip-support', f'--benchmark={bench}', f'--logdir=logs/{bench}'], cwd=cwd)
 
         def gather(data, name, type_):
             individual = data[f"detailed {name} results"]
@@ -114,9 +398,35 @@ class Runner():
             # for row in gathered: # CSV print
             #     print(','.join(map(str, row)))
 
-        speeds = gather(speed_json.popitem()[1], "speed", float)
-        sizes = gather(size_json.popitem()[1], "size", int)
-        return ("EmBench", (speeds, sizes))
+        def size():
+            size_json = json.loads(r(size_args, cwd=cwd))
+            return gather(size_json.popitem()[1], "size", int)
+
+        def collect():
+            # Relative to the baseline like benchmark_speed.py does by default
+            rel = [(bench, baseline[bench] / sims[bench].result[0]) for bench in benches]
+            geomean = math.prod(speed for _, speed in rel) ** (1.0 / len(rel))
+            speeds = [("geometric mean", geomean)] + rel
+            # Counters add up over the suite rather than averaging
+            counts = [(bench, sims[bench].result[1]) for bench in benches]
+            total = {}
+            for _, c in counts:
+                for key, val in c.items():
+                    total[key] = total.get(key, 0) + val
+            return ("EmBench", (speeds, size_job.result, [("total", total)] + counts))
+
+        supported = sched.add('EmBench support', support, cost=5)
+        builds = {}
+        sims = {}
+        for bench in benches:
+            builds[bench] = sched.add(f'EmBench build {bench}', partial(build, bench), [supported], cost=2)
+            appdir = cwd / 'bd' / 'src' / bench
+            _, sim_deps = self.add_snapshot(sched, f'EmBench {bench}', bench, 'RV32GC', appdir, builds[bench])
+            sims[bench] = sched.add(f'EmBench sim {bench}', partial(self.sim_embench, cwd, bench, target_args), sim_deps, cost=10)
+            if self.PROFILE:
+                self.profile_jobs[('EmBench', bench)] = sched.add(f'EmBench profile {bench}', partial(self.profile_embench, cwd, bench), sim_deps, cost=100)
+        size_job = sched.add('EmBench size', size, builds.values(), cost=2)
+        return sched.add('EmBench', collect, list(sims.values()) + [size_job], cost=0)
 
 
     def get_versions(self):
@@ -141,17 +451,25 @@ class Runner():
         print(f"RISC-V benchmarks {versions[0]}, CC version {versions[1]}")
 
 
+    def add_jobs(self, sched, b):
+        """Add all steps of benchmark suite "b" to scheduler "sched" and return
+           the final job, whose result is (name, (speed, size, counters)).
+           For suites with sub-benchmarks each of these is a list of
+           (sub-benchmark, value) pairs, led by the suite-wide figure."""
+        adders = {
+            "AudioMark": self.add_audiomark,
+            "CoreMark": self.add_coremark,
+            "EmBench": self.add_embench,
+        }
+        return adders[b](sched)
+
+
     def run_bench(self, b):
-        # This is pretty stupid
-        if b == "AudioMark":
-            return self.run_audiomark()
-        elif b == "CoreMark":
-            return self.run_coremark()
-        elif b == "EmBench":
-            return self.run_embench()
-        else:
-            # This is super stupid
-            assert False, "Unreachable?"
+        sched = Scheduler()
+        final = self.add_jobs(sched, b)
+        for _ in sched.run():
+            pass
+        return final.get()
 
 
 def main():
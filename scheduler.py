@@ -0,0 +1,129 @@
+# Copyright HighTec EDV-Systeme GmbH 2023
+# SPDX-License-Identifier: BSD-1-Clause
+
+# A small DAG scheduler for build/size/simulate steps of all suites.
+# Jobs run on a bounded thread pool (they mostly wait on subprocesses) and
+# the ready job with the longest remaining critical path goes first, so long
+# Spike runs start as early as their dependencies allow. Job costs come from
+# the durations measured on the previous run, falling back to a guess.
+
+import concurrent.futures
+import heapq
+import json
+import os
+import time
+from pathlib import Path
+
+HISTORY = Path(__file__).resolve().parent / '.cache' / 'durations.json'
+
+
+class Job():
+    def __init__(self, name, fn, deps, cost):
+        self.name = name
+        self.fn = fn
+        self.deps = list(deps)
+        self.cost = cost
+        self.dependents = []
+        self.rank = 0.0
+        self.result = None
+        self.error = None
+        self.duration = None
+
+    def get(self):
+        if self.error:
+            raise self.error
+        return self.result
+
+
+class Scheduler():
+    def __init__(self, workers=None):
+        self.workers = workers or os.cpu_count() or 1
+        self.jobs = {}
+        try:
+            self.history = json.loads(HISTORY.read_text())
+        except (OSError, ValueError):
+            self.history = {}
+
+    def add(self, name, fn, deps=(), cost=1.0):
+        """Add job "name" running "fn()" once all "deps" (jobs) have finished.
+           "cost" is a guess in seconds, used until we have measured it once."""
+        assert name not in self.jobs, f"Duplicate job {name}"
+        job = Job(name, fn, deps, self.history.get(name, cost))
+        for dep in job.deps:
+            dep.dependents.append(job)
+        self.jobs[name] = job
+        return job
+
+    def compute_ranks(self):
+        # Upward rank: own cost plus the most expensive chain of dependents
+        order = []
+        seen = set()
+        def visit(job):
+            if job.name in seen:
+                return
+            seen.add(job.name)
+            for d in job.dependents:
+                visit(d)
+            order.append(job)
+        for job in self.jobs.values():
+            visit(job)
+        for job in order:
+            job.rank = job.cost + max((d.rank for d in job.dependents), default=0.0)
+
+    def timed(self, job):
+        start = time.monotonic()
+        try:
+            return job.fn()
+        finally:
+            job.duration = time.monotonic() - start
+
+    def run(self):
+        """Run all jobs, yielding each one in the calling thread as it finishes.
+           A failed job's error is propagated to everything depending on it."""
+        self.compute_ranks()
+        waiting = {job.name: len(job.deps) for job in self.jobs.values()}
+        ready = [(-job.rank, i, job) for i, job in enumerate(self.jobs.values()) if not job.deps]
+        heapq.heapify(ready)
+        counter = len(self.jobs)
+        running = {}
+
+        def finish(job):
+            nonlocal counter
+            for d in job.dependents:
+                if job.error and not d.error:
+                    d.error = job.error
+                waiting[d.name] -= 1
+                if waiting[d.name] == 0:
+                    counter += 1
+                    heapq.heappush(ready, (-d.rank, counter, d))
+
+        with concurrent.futures.ThreadPoolExecutor(max_workers=self.workers) as executor:
+            while ready or running:
+                while ready and len(running) < self.workers:
+                    _, _, job = heapq.heappop(ready)
+                    if job.error:
+                        # Skipped because a dependency failed
+                        finish(job)
+                        yield job
+                        continue
+                    running[executor.submit(self.timed, job)] = job
+                if not running:
+                    continue
+                done, _ = concurrent.futures.wait(running, return_when=concurrent.futures.FIRST_COMPLETED)
+                for future in done:
+                    job = running.pop(future)
+                    try:
+                        job.result = future.result()
+                    except Exception as e:
+                        job.error = e
+                    finish(job)
+                    yield job
+
+        self.save_history()
+
+    def save_history(self):
+        for job in self.jobs.values():
+            if job.duration is not None and not job.error:
+                self.history[job.name] = round(job.duration, 3)
+        HISTORY.parent.mkdir(parents=True, exist_ok=True)
+        HISTORY.write_text(json.dumps(self.history, indent=1, sort_keys=True))
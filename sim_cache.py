@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright HighTec EDV-Systeme GmbH 2023
+# SPDX-License-Identifier: BSD-1-Clause
+
+# Memoizes simulator runs, used as a launcher in front of the Spike command:
+#
+#     sim_cache.py <elf> [<input>...] -- <command...>
+#
+# Results live in a sqlite database keyed on the SHA-256 of the ELF and the
+# command line. Files the simulated program reads from the host (AudioMark's
+# streamed WAVs) go before the "--" and are hashed along with the ELF. On a
+# hit the recorded stdout/stderr are replayed instead of launching the
+# simulator, so the usual log scraping keeps working. Only successful runs
+# are recorded.
+
+import hashlib
+import os
+import sqlite3
+import subprocess
+import sys
+from pathlib import Path
+
+DB_PATH = Path(os.environ.get('SIM_CACHE_DB', Path(__file__).resolve().parent / '.cache' / 'sim.sqlite'))
+
+
+def sha256_file(path):
+    h = hashlib.sha256()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(1 << 20), b''):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def connect():
+    DB_PATH.parent.mkdir(parents=True, exist_ok=True)
+    # Embench launches a few dozen of us at once
+    db = sqlite3.connect(DB_PATH, timeout=60)
+    db.execute('PRAGMA journal_mode=WAL')
+    db.execute('''CREATE TABLE IF NOT EXISTS results (
+        elf_sha256 TEXT NOT NULL,
+        command TEXT NOT NULL,
+        stdout BLOB NOT NULL,
+        stderr BLOB NOT NULL,
+        created TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+        PRIMARY KEY (elf_sha256, command))''')
+    return db
+
+
+def command_key(command):
+    return '\0'.join(command)
+
+
+def lookup(elf_hash, command):
+    with connect() as db:
+        return db.execute('SELECT stdout, stderr FROM results WHERE elf_sha256 = ? AND command = ?',
+                          (elf_hash, command_key(command))).fetchone()
+
+
+def record(elf_hash, command, stdout, stderr):
+    with connect() as db:
+        db.execute('INSERT OR REPLACE INTO results (elf_sha256, command, stdout, stderr) VALUES (?, ?, ?, ?)',
+                   (elf_hash, command_key(command), stdout, stderr))
+
+
+def run(elf, command, inputs=(), **kwargs):
+    """subprocess.run(command) with stdout/stderr captured as bytes, unless
+       this ELF already ran on these inputs with this exact command line"""
+    elf_hash = sha256_file(elf)
+    if inputs:
+        elf_hash = hashlib.sha256(' '.join([elf_hash] + [sha256_file(i) for i in inputs]).encode()).hexdigest()
+    hit = lookup(elf_hash, command)
+    if hit:
+        return subprocess.CompletedProcess(command, 0, hit[0], hit[1])
+    res = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, **kwargs)
+    if res.returncode == 0:
+        record(elf_hash, command, res.stdout, res.stderr)
+    return res
+
+
+def main(argv):
+    if '--' not in argv[2:] or argv.index('--', 2) == len(argv) - 1:
+        print(f'usage: {argv[0]} <elf> [<input>...] -- <command...>', file=sys.stderr)
+        return 2
+    sep = argv.index('--', 2)
+    elf, inputs, command = argv[1], argv[2:sep], argv[sep + 1:]
+
+    if os.environ.get('SIM_CACHE', '1') == '0':
+        return subprocess.run(command).returncode
+
+    res = run(elf, command, inputs)
+    sys.stdout.buffer.write(res.stdout)
+    sys.stderr.buffer.write(res.stderr)
+    return res.returncode
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,69 @@
+# Copyright HighTec EDV-Systeme GmbH 2023
+# SPDX-License-Identifier: BSD-1-Clause
+
+# Statistics over the repeated runs of a column (REPEAT=n in ./env). Cells
+# show the median of their samples. The medians' 95% confidence intervals
+# come from a percentile bootstrap, which makes no assumption about the
+# noise distribution and copes with the handful of samples a run can afford.
+# Resampling is seeded, so redrawing a table gives the same intervals.
+
+import random
+from functools import lru_cache
+
+RESAMPLES = 1000
+CONFIDENCE = 0.95
+
+
+def median(xs):
+    s = sorted(xs)
+    n = len(s)
+    return s[n // 2] if n % 2 else (s[n // 2 - 1] + s[n // 2]) / 2
+
+
+def percentile(s, q):
+    """Nearest-rank percentile "q" (0..1) of the sorted list "s" """
+    return s[min(len(s) - 1, max(0, round(q * (len(s) - 1))))]
+
+
+def resample(rng, xs):
+    return rng.choices(xs, k=len(xs))
+
+
+def interval(stats):
+    s = sorted(stats)
+    tail = (1 - CONFIDENCE) / 2
+    return percentile(s, tail), percentile(s, 1 - tail)
+
+
+@lru_cache(maxsize=None)
+def median_ci(samples):
+    """(low, high) of the median of the tuple "samples", None with fewer
+       than two samples"""
+    if len(samples) < 2:
+        return None
+    rng = random.Random(0)
+    return interval(median(resample(rng, samples)) for _ in range(RESAMPLES))
+
+
+@lru_cache(maxsize=None)
+def ratio_ci(base, new):
+    """(low, high) of median(new) / median(base) for the sample tuples "base"
+       and "new", None unless both have at least two samples"""
+    if len(base) < 2 or len(new) < 2:
+        return None
+    if len(set(base)) == 1 and len(set(new)) == 1:
+        # Sizes and deterministic simulators, nothing to resample
+        return (new[0] / base[0] if base[0] else float('inf'),) * 2
+    rng = random.Random(0)
+    ratios = []
+    for _ in range(RESAMPLES):
+        b = median(resample(rng, base))
+        ratios.append(median(resample(rng, new)) / b if b else float('inf'))
+    return interval(ratios)
+
+
+def significant(base, new):
+    """Whether the ratio of medians of "new" over "base" differs from 1
+       beyond the noise of both"""
+    ci = ratio_ci(tuple(base), tuple(new))
+    return ci is not None and (ci[0] > 1 or ci[1] < 1)
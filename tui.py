@@ -2,8 +2,9 @@
 # SPDX-License-Identifier: BSD-1-Clause
 
 import curses
-import concurrent.futures
 from run_all import Runner
+from scheduler import Scheduler
+import stats
 from enum import Enum, auto
 from itertools import cycle
 from pathlib import Path
@@ -16,6 +17,11 @@ class Modes(Enum):
     Size = 1
     RelSpeed = 2
     RelSize = 3
+    # Counter deltas from common/perf_counters.h
+    Cycles = 4
+    Instret = 5
+    # Half width of the speed median's confidence interval with REPEAT=n
+    Noise = 6
 
 
 class Benches(Enum):
@@ -25,6 +31,22 @@ class Benches(Enum):
 
 
 SUBS = {
+    # Pipeline stages, see audiomark/ports/riscv/boardsupport.c
+    "AudioMark": [
+        "other",
+        "bmf",
+        "aec",
+        "anr",
+        "kws",
+    ],
+    # Kernels with COREMARK_KERNELS=1, see Coremark/riscv32-spike/core_kernels.c
+    "CoreMark": [
+        "other",
+        "list",
+        "matrix",
+        "state",
+        "crc",
+    ],
     "EmBench": [
         "aha-mont64",
         "crc32",
@@ -61,10 +83,16 @@ def iter_subs():
 def len_subs():
     return sum(1 for _ in iter_subs())
 
+# Counter name in the PERF line for each counter mode
+COUNTERS = {
+    Modes.Cycles: 'cycles',
+    Modes.Instret: 'instret',
+}
+
 class Tui():
     WIDTH = 12
     # Suites with multiple executables
-    DETAILED = [Benches.EmBench]
+    DETAILED = [Benches.AudioMark, Benches.CoreMark, Benches.EmBench]
 
     def __init__(self, stdscr):
         # Curses setup
@@ -74,8 +102,15 @@ class Tui():
         # No data yet
         self.col = 0
         self.baseline_col = 0
+        # Cell to drill down into, the column defaults to the latest run
+        self.sel_row = 0
+        self.sel_col = None
+        # Per column, profile by row (only with PROFILE=1 in ./env)
+        self.profiles = []
         self.labels = self.init_labels()
         self.data = self.init_array()
+        # Numeric results of the repeated runs behind each cell of self.data
+        self.samples = self.init_array()
         self.modes_cycle = cycle(Modes)
         self.detail_cycle = cycle(self.DETAILED)
         self.mode = next(self.modes_cycle)
@@ -83,6 +118,7 @@ class Tui():
         assert self.mode == Modes.Speed
         self.repo_version = Runner().get_versions()[0]
         self.cc_ids = []
+        self.failed = []
         # Initial UI setup
         self.status = ""
         self.help = True
@@ -95,6 +131,13 @@ class Tui():
     def cycle_detail(self):
         self.detail = next(self.detail_cycle)
 
+    def adjust_selection(self, row_incr, col_incr):
+        rows = len(Benches) + len_subs()
+        self.sel_row = max(0, min(self.sel_row + row_incr, rows - 1))
+        if self.col:
+            col = self.col - 1 if self.sel_col is None else self.sel_col
+            self.sel_col = max(0, min(col + col_incr, self.col - 1))
+
     def adjust_baseline(self, incr):
         self.baseline_col = self.baseline_col + incr
         self.baseline_col = max(0, min(self.baseline_col, self.col - 1))
@@ -124,7 +167,8 @@ class Tui():
                         # TODO flush the screen instead?
                         logging.debug(str_val)
                         assert len(str_val) == l, "Formatting error"
-                        self.stdscr.addstr(i + 2, (j + 1) * self.WIDTH, str_val)
+                        attr = curses.A_REVERSE if (i, j) == (self.sel_row, self.selected_col()) else curses.A_NORMAL
+                        self.stdscr.addstr(i + 2, (j + 1) * self.WIDTH, str_val, attr)
                     except curses.error as e:
                         curses.endwin()
                         print("curses error, terminal probably too narrow")
@@ -141,13 +185,13 @@ class Tui():
 
     # Change bottom help/status line
     def draw_status(self):
-        height, _ = self.stdscr.getmaxyx()
+        height, width = self.stdscr.getmaxyx()
         end = height - 1
         
         self.clear_line(end - 1)
         self.stdscr.addstr(end - 1, 0, self.status)
         if self.help:
-            self.stdscr.addstr(end, 0, "[q]uit [r]un [m]ode [c]sv [d]elete [←|→] change baseline")
+            self.stdscr.addstr(end, 0, "[q]uit [r]un [m]ode [c]sv [d]elete [←|→] change baseline [↑|↓|,|.] select [p]rofile diff"[:width - 1])
         self.stdscr.refresh()
 
 
@@ -168,85 +212,247 @@ class Tui():
         for mode_array in self.data:
             for i in range(len(Benches) + len_subs()):
                 mode_array[i].append('...')
+        for mode_array in self.samples:
+            for i in range(len(Benches) + len_subs()):
+                mode_array[i].append([])
+        self.profiles.append({})
         self.col += 1
+        self.sel_col = None
 
 
     def del_col(self):
-        for mode_array in self.data:
+        for mode_array in self.data + self.samples:
             for i in range(len(Benches) + len_subs()):
                 mode_array[i].pop()
         self.cc_ids.pop()
+        self.profiles.pop()
         self.col -= 1
+        self.sel_col = None
         self.adjust_baseline(0)
 
 
-    def set_done(self, num_done):
-        self.status = f"Running benchmarks... {num_done}/{len(Benches)}"
+    def selected_col(self):
+        return self.col - 1 if self.sel_col is None else self.sel_col
+
+
+    def store_profiles(self, runner):
+        """Keep the profiles of this run, the EmBench row gets all of its
+           benchmarks with symbols prefixed by the benchmark name"""
+        profiles = self.profiles[self.col - 1]
+        for key, job in runner.profile_jobs.items():
+            if job.error:
+                continue
+            if isinstance(key, tuple):
+                idx = len(Benches) + list(iter_subs()).index(key)
+                profiles[idx] = job.result
+                merged = profiles.setdefault(Benches[key[0]].value, {})
+                for sym, count in job.result.items():
+                    merged[f"{key[1]}:{sym}"] = count
+            else:
+                profiles[Benches[key].value] = job.result
+
+
+    def profile_diff(self):
+        """Show the functions of the selected row whose instruction count
+           changed most from the baseline column to the selected column"""
+        col = self.selected_col()
+        if self.col == 0:
+            return
+        base = self.profiles[self.baseline_col].get(self.sel_row)
+        new = self.profiles[col].get(self.sel_row)
+        if base is None or new is None:
+            self.status = f"No profile for {self.labels[self.sel_row]}, set PROFILE=1 in ./env"
+            self.render()
+            return
+
+        diff = []
+        for sym in base.keys() | new.keys():
+            b, n = base.get(sym, 0), new.get(sym, 0)
+            if b != n:
+                diff.append((n - b, sym, b, n))
+        diff.sort(key=lambda d: (-abs(d[0]), d[1]))
+
+        height, width = self.stdscr.getmaxyx()
+        self.stdscr.clear()
+        b_total, n_total = sum(base.values()), sum(new.values())
+        self.stdscr.addstr(0, 0, f"{self.labels[self.sel_row]}: column {self.baseline_col + 1} -> {col + 1}, "
+                                 f"{b_total} -> {n_total} instructions ({n_total - b_total:+})"[:width - 1])
+        self.stdscr.addstr(1, 0, f"{'delta':>12} {'%':>8} {'before':>12} {'after':>12}  function"[:width - 1])
+        for i, (delta, sym, b, n) in enumerate(diff[:height - 4]):
+            rel = f"{delta / b:+.1%}" if b else "new"
+            self.stdscr.addstr(i + 2, 0, f"{delta:+12} {rel:>8} {b:12} {n:12}  {sym}"[:width - 1])
+        self.stdscr.addstr(height - 1, 0, "Press any key to return"[:width - 1])
+        self.stdscr.refresh()
+        self.stdscr.getch()
+        self.render()
+
+
+    def set_done(self, num_done, what="Running benchmarks"):
+        self.status = f"{what}... {num_done}/{len(Benches)}"
         self.help = False
 
 
+    def set_cell(self, mode, row, value):
+        """Add a result to the newest column, which shows the median of the
+           numeric results of its repetitions"""
+        if isinstance(value, (int, float)):
+            samples = self.samples[mode.value][row][self.col - 1]
+            samples.append(value)
+            value = stats.median(samples)
+        self.data[mode.value][row][self.col - 1] = value
+
+
+    def set_failed(self, row):
+        """Mark the row of a suite whose jobs failed in the newest column,
+           unless an earlier repetition got results"""
+        if self.samples[Modes.Speed.value][row][self.col - 1]:
+            return
+        for mode in [Modes.Speed, Modes.Size] + list(COUNTERS):
+            self.set_cell(mode, row, 'failed')
+
+
+    def set_counters(self, row, counts):
+        # Binaries without perf_counters.h don't print any
+        for mode, key in COUNTERS.items():
+            self.set_cell(mode, row, counts.get(key, 'n/a'))
+
+
     def update_relative(self):
-        def percent(x):
-            return f"{x:.1%}"
+        # Relative values get a "*" if the difference to the baseline is
+        # outside the confidence interval, which needs REPEAT>1 in ./env
+        def relative(mode, i, c):
+            data = self.data[mode.value][i]
+            samples = self.samples[mode.value][i]
+            # Rows a run didn't fill, like the CoreMark kernels without
+            # COREMARK_KERNELS=1, have no numbers to compare
+            if not samples[c] or not samples[self.baseline_col] or not data[self.baseline_col]:
+                return 'n/a'
+            mark = "*" if c != self.baseline_col and stats.significant(samples[self.baseline_col], samples[c]) else " "
+            return f"{float(data[c]) / float(data[self.baseline_col]):.1%}{mark}"
+
+        def noise(i, c):
+            ci = stats.median_ci(tuple(self.samples[Modes.Speed.value][i][c]))
+            median = self.data[Modes.Speed.value][i][c]
+            if ci is None or not median:
+                return 'n/a'
+            return f"±{(ci[1] - ci[0]) / 2 / median:.1%}"
 
         for c in range(self.col):
             for i in range(len(Benches) + len_subs()):
-                speed_data = self.data[Modes.Speed.value][i]
-                size_data = self.data[Modes.Size.value][i]
-                rel_speed_data = self.data[Modes.RelSpeed.value][i]
-                rel_size_data = self.data[Modes.RelSize.value][i]
-                rel_speed_data[c] = percent(float(speed_data[c]) / float(speed_data[self.baseline_col]))
-                rel_size_data[c] = percent(float(size_data[c]) / float(size_data[self.baseline_col]))
+                self.data[Modes.RelSpeed.value][i][c] = relative(Modes.Speed, i, c)
+                self.data[Modes.RelSize.value][i][c] = relative(Modes.Size, i, c)
+                self.data[Modes.Noise.value][i][c] = noise(i, c)
 
     def run_all(self):
         # This also reloads the environment file
         runner = Runner()
-        # Include paths are boring, filter them out
-        perf_opts = ' '.join(list(filter(lambda x: '-I' not in x and 'nostartfiles' not in x, runner.CFLAGS.split(' '))))
+        # Suites whose jobs failed, the others keep going
+        self.failed = []
+        self.run_column(runner)
+        if runner.PGO:
+            # PGO=1 adds a column built with the profile of a training run,
+            # see Runner.set_pgo()
+            runner.set_pgo('generate')
+            self.run_training(runner)
+            try:
+                runner.merge_pgo()
+            except Exception as e:
+                logging.warning(f"PGO merge: {e}")
+                self.failed.append("PGO merge")
+            else:
+                runner.set_pgo('use')
+                self.run_column(runner)
+            runner.set_pgo(None)
+        self.status = "Done!"
+        if self.failed:
+            self.status += f" Failed: {', '.join(self.failed)}, see debug.log"
+        self.help = True
+        self.render()
+
+
+    def run_training(self, runner):
+        """Build and run the instrumented binaries, the results only matter
+           for the profiles they write"""
+        done = 0
+        self.set_done(done, "Training PGO profiles")
+        self.render()
+        sched = Scheduler()
+        finals = [runner.add_jobs(sched, b) for b in Benches.__members__]
+        for job in sched.run():
+            if job in finals:
+                if job.error:
+                    logging.warning(f"{job.name} PGO training: {job.error}")
+                    self.failed.append(f"{job.name} PGO training")
+                done += 1
+                self.set_done(done, "Training PGO profiles")
+                self.render()
+                self.stdscr.refresh()
+
+
+    def run_column(self, runner):
+        # Include paths are boring, filter them out, and the PGO flags are
+        # long, shorten them
+        perf_opts = ' '.join(list(filter(lambda x: '-I' not in x and 'nostartfiles' not in x and 'profile' not in x, runner.CFLAGS.split(' '))))
+        if runner.pgo == 'use':
+            perf_opts += ' PGO'
         self.cc_ids.append((runner.get_versions()[1], perf_opts))
         # New column for this run
         self.add_col()
-        done = 0
-        # Initialize progress counter
-        self.set_done(done)
-
-        # Run the benchmark simulations in parallel
-        with concurrent.futures.ThreadPoolExecutor() as executor:
-            futures = [executor.submit(runner.run_bench, b) for b in Benches.__members__]
-            # Iterate over results as we get them
-            for future in concurrent.futures.as_completed(futures):
-                res = future.result()
-                if res:
-                    b, (speeds, sizes) = future.result()
-                    # Get a "mutable reference" to a row (Python sucks)
-                    speed_data = self.data[Modes.Speed.value][Benches[b].value]
-                    size_data = self.data[Modes.Size.value][Benches[b].value]
-                    # Fill in the corresponding fields in the new column
-                    if Benches[b] in self.DETAILED:
-                        # TODO use self.detail cycle
-                        speed_data[self.col - 1] = speeds[0][1]
-                        size_data[self.col - 1] = sizes[0][1]
-                        for ((sub_name, speed), (_, size)) in zip(speeds, sizes):
-                            if sub_name == 'geometric mean':
-                                continue
-                            size_data[self.col - 1] = sizes[0][1]
-                            name = f"{Benches[b]}_{sub_name}"
-                            # logging.debug(f"{name}:{speed}:{size}")
-                            idx = len(Benches) + list(iter_subs()).index((Benches[b].name, sub_name))
-                            self.data[Modes.Speed.value][idx][self.col - 1] = speed
-                            self.data[Modes.Size.value][idx][self.col - 1] = size
-                    else:
-                        speed_data[self.col - 1] = speeds
-                        size_data[self.col - 1] = sizes
-                    done += 1
-                    self.set_done(done)
-                    self.render()
-                    self.stdscr.refresh()
+        for i in range(runner.REPEAT):
+            runner.set_repeat(i)
+            what = "Running benchmarks" if runner.REPEAT == 1 else f"Running benchmarks, run {i + 1}/{runner.REPEAT}"
+            self.run_once(runner, what)
 
+        self.store_profiles(runner)
         self.update_relative()
-        self.status = "Done!"
-        self.help = True
-        self.render()
+
+
+    def run_once(self, runner, what):
+        """Build and run everything once, adding the results to the newest
+           column"""
+        done = 0
+        # Initialize progress counter
+        self.set_done(done, what)
+
+        # Build, size and simulate everything on one bounded worker pool
+        sched = Scheduler()
+        finals = [runner.add_jobs(sched, b) for b in Benches.__members__]
+        # Iterate over results as we get them
+        for job in sched.run():
+            if job not in finals:
+                continue
+            res = None if job.error else job.get()
+            if job.error:
+                # The row reads "failed", the other suites go on
+                logging.warning(f"{job.name}: {job.error}")
+                if job.name not in self.failed:
+                    self.failed.append(job.name)
+                self.set_failed(Benches[job.name].value)
+            elif res:
+                b, (speeds, sizes, counts) = res
+                row = Benches[b].value
+                # Fill in the corresponding fields in the new column
+                if Benches[b] in self.DETAILED:
+                    # TODO use self.detail cycle
+                    self.set_cell(Modes.Speed, row, speeds[0][1])
+                    self.set_cell(Modes.Size, row, sizes[0][1])
+                    self.set_counters(row, counts[0][1])
+                    # The first entries are the suite-wide figures
+                    for ((sub_name, speed), (_, size), (_, count)) in zip(speeds[1:], sizes[1:], counts[1:]):
+                        name = f"{Benches[b]}_{sub_name}"
+                        # logging.debug(f"{name}:{speed}:{size}")
+                        idx = len(Benches) + list(iter_subs()).index((Benches[b].name, sub_name))
+                        self.set_cell(Modes.Speed, idx, speed)
+                        self.set_cell(Modes.Size, idx, size)
+                        self.set_counters(idx, count)
+                else:
+                    self.set_cell(Modes.Speed, row, speeds)
+                    self.set_cell(Modes.Size, row, sizes)
+                    self.set_counters(row, counts)
+            done += 1
+            self.set_done(done, what)
+            self.render()
+            self.stdscr.refresh()
 
 
     def dump_csv(self):
@@ -271,7 +477,7 @@ class Tui():
         with open(filename, "w", newline="") as csvfile:
             csv_writer = csv.writer(csvfile)
             csv_writer.writerow([f"RISC-V benchmark suite {self.repo_version}"] + self.cc_ids)
-            for mode in [Modes.Speed, Modes.Size]:
+            for mode in [Modes.Speed, Modes.Size, Modes.Cycles, Modes.Instret, Modes.Noise]:
                 csv_writer.writerow([mode])
                 mode_array = self.data[mode.value]
                 for row in mode_array:
@@ -323,6 +529,25 @@ def main(stdscr):
             tui.adjust_baseline(-1)
             tui.render()
 
+        if key == curses.KEY_UP:
+            tui.adjust_selection(-1, 0)
+            tui.render()
+
+        if key == curses.KEY_DOWN:
+            tui.adjust_selection(+1, 0)
+            tui.render()
+
+        if key == ord(','):
+            tui.adjust_selection(0, -1)
+            tui.render()
+
+        if key == ord('.'):
+            tui.adjust_selection(0, +1)
+            tui.render()
+
+        if key == ord('p') or key == ord('P'):
+            tui.profile_diff()
+
 if __name__ == "__main__":
     logging.basicConfig(filename='debug.log', level=logging.WARNING)
     curses.wrapper(main)